@@ -5,16 +5,32 @@ warnings="-Wno-writable-strings -Wno-format-security -Wno-c++11-extensions -Wno-
 includes="-Ithird_party"
 timestamp=$(date +%s)
 
+# ./build.sh release compiles game.cpp right into main, optimized and without Hot Reload
+release=false
+if [[ "$1" == "release" ]]; then
+    release=true
+fi
+
+# ./build.sh headless compiles a release without Window, Input or Audio,
+# it plays back the Replay in SM_REPLAY as fast as it can and quits
+headless=false
+if [[ "$1" == "headless" ]]; then
+    release=true
+    headless=true
+fi
+
 if [[ "$(uname)" == "Linux" ]]; then
     echo "Running on Linux"
-    libs="-lX11 -lGL -lfreetype"
+    libs="-lX11 -lGL -lfreetype -lpthread -ldl"
     outputFile=schnitzel
     queryProcesses=$(pgrep $outputFile)
 
     # fPIC position independent code
     rm -f game_* # Remove old game_* files
-    clang++ -g "src/game.cpp" -shared -fPIC -o game_$timestamp.so $warnings $defines
-    mv game_$timestamp.so game.so
+    if [ "$release" = false ]; then
+        clang++ -g "src/game.cpp" -shared -fPIC -o game_$timestamp.so $warnings $defines
+        mv game_$timestamp.so game.so
+    fi
 
 elif [[ "$(uname)" == "Darwin" ]]; then
     echo "Running on Mac"
@@ -32,15 +48,33 @@ else
     queryProcesses=$(tasklist | grep $outputFile)
 
     rm -f game_* # Remove old game_* files
-    clang++ -g "src/game.cpp" -shared -o game_$timestamp.dll $warnings $defines
-    mv game_$timestamp.dll game.dll
+    if [ "$release" = false ]; then
+        clang++ -g "src/game.cpp" -shared -o game_$timestamp.dll $warnings $defines
+        mv game_$timestamp.dll game.dll
+    fi
+fi
+
+if [ "$headless" = true ]; then
+    libs="-lpthread"
+    if [[ "$(uname)" == "Linux" ]]; then
+        libs="-lpthread -ldl"
+    fi
+    objc_dep=""
+    defines="$defines -DSM_HEADLESS"
+    outputFile=schnitzel_headless
+    queryProcesses=""
 fi
 
 processRunning=$queryProcesses
 
 if [ -z "$processRunning" ]; then
-    echo "Engine not running, building main..."
-    clang++ $includes -g "src/main.cpp" $objc_dep -o $outputFile $libs $warnings $defines
+    if [ "$release" = true ]; then
+        echo "Engine not running, building release..."
+        clang++ $includes -O2 -flto "src/main.cpp" $objc_dep -o $outputFile $libs $warnings $defines -DSM_RELEASE
+    else
+        echo "Engine not running, building main..."
+        clang++ $includes -g "src/main.cpp" $objc_dep -o $outputFile $libs $warnings $defines
+    fi
 else
     echo "Engine running, not building!"
 fi
@@ -1,4 +1,7 @@
 #include "game.h"
+#include "level_file.h"
+#include "rewind.h"
+#include "replay.h"
 #include "assets.h"
 #include "input.h"
 #include "render_interface.h"
@@ -7,6 +10,10 @@
 //                           Game Constants
 // #############################################################################
 constexpr float DEATH_ANIM_TIME = 0.25f;
+constexpr float RUN_ANIM_TIME = 0.5f;
+
+// Page Up and Page Down while a Replay plays
+constexpr int REPLAY_SEEK_TICKS = 10 * UPDATES_PER_SECOND;
 
 // #############################################################################
 //                           Game Globals
@@ -17,7 +24,13 @@ static BumpAllocator* transientStorage;
 //                           Game Functions
 // #############################################################################
 // Input
+void sample_game_input(GameInput* sampled);
 void update_game_input(float dt);
+void reset_input();
+void update_replay();
+void seek_replay(int tick);
+bool check_replay();
+bool editing_allowed();
 bool is_down(GameInputType type);
 bool just_pressed(GameInputType type);
 
@@ -51,22 +64,27 @@ void update();
 // #############################################################################
 EXPORT_FN void update_game(GameState* gameStateIn, Input* inputIn, RenderData* renderDataIn, 
                            SoundState* soundStateIn, UIState* uiStateIn,
-                           BumpAllocator* transientStorageIn, float frameTime)
+                           SaveState* saveStateIn, RewindState* rewindStateIn,
+                           ReplayState* replayStateIn, BumpAllocator* transientStorageIn, 
+                           float frameTime)
 {
-  if(gameState != gameStateIn)
+  // Release Builds share the other Globals with main.cpp, which sets them
+  // itself, only transientStorage is always left to this
+  if(transientStorage != transientStorageIn)
   {
     gameState = gameStateIn;
     input = inputIn;
     renderData = renderDataIn;
     soundState = soundStateIn;
     uiState = uiStateIn;
+    saveState = saveStateIn;
+    rewindState = rewindStateIn;
+    replayState = replayStateIn;
     transientStorage = transientStorageIn;
 
-    // Sounds
-    char* jumpSound = "assets/sounds/jump_01.wav";
-    char* deathSound = "assets/sounds/died_02.wav";
-    memcpy(gameState->jumpSound.path, jumpSound, strlen(jumpSound));
-    memcpy(gameState->deathSound.path, deathSound, strlen(deathSound));
+    // Sounds, interned once, already registered paths return the same Handle
+    gameState->jumpSound = register_sound("assets/sounds/jump_01.wav", SOUND_LOAD_MAPPED);
+    gameState->deathSound = register_sound("assets/sounds/died_02.wav", SOUND_LOAD_MAPPED);
   }
 
   if(!gameState->initialized)
@@ -76,6 +94,8 @@ EXPORT_FN void update_game(GameState* gameStateIn, Input* inputIn, RenderData* r
     gameState->player.animationSprites [ANIMATION_STATE_JUMP] = SPRITE_CELESTE_01_JUMP;
     gameState->player.animationSprites [ANIMATION_STATE_RUN] = SPRITE_CELESTE_01_RUN;
     gameState->player.deathAnimTimer = DEATH_ANIM_TIME;
+    gameState->player.grounded = true;
+    gameState->player.dashCounter = 1;
     gameState->level.playerStartPos = {0, -4 * 8};
     gameState->player.pos = gameState->level.playerStartPos;
     gameState->player.prevPos = gameState->player.pos;
@@ -83,14 +103,9 @@ EXPORT_FN void update_game(GameState* gameStateIn, Input* inputIn, RenderData* r
     bool loadedLevel = false;
     if(file_exists("level.bin"))
     {
-      int fileSize;
-      Level* level = (Level*)read_file("level.bin", &fileSize, transientStorage);
-
-      if(fileSize == sizeof(Level))
-      {
-        gameState->level = *level;
-        loadedLevel = true;
-      }
+      long long loadStartUs = get_time_us();
+      loadedLevel = load_level_file("level.bin", &gameState->level, transientStorage);
+      SM_TRACE("Loaded level.bin in %.3f ms", (get_time_us() - loadStartUs) / 1000.0);
     }
 
     // Init Level
@@ -184,6 +199,9 @@ EXPORT_FN void update_game(GameState* gameStateIn, Input* inputIn, RenderData* r
     renderData->gameCamera.zoom = 1.0f;
     renderData->gameCamera.position.y = 
       renderData->gameCamera.dimensions.y / 2.0f;
+    gameState->cameraPos = renderData->gameCamera.position;
+    gameState->cameraStartPos = gameState->cameraPos;
+    gameState->cameraEndPos = gameState->cameraPos;
     gameState->cameraTimer = 1.0f;
 
     // UI Camera
@@ -197,21 +215,27 @@ EXPORT_FN void update_game(GameState* gameStateIn, Input* inputIn, RenderData* r
     gameState->initialized = true;
   }
 
+  update_sounds();
+
+  update_replay();
+
   gameState->updateTimer += frameTime;
   while(gameState->updateTimer >= UPDATE_DELAY)
   {
     gameState->updateTimer -= UPDATE_DELAY;
-    update();
 
-    // Reset Input
-    // input->wheelDelta = 0;
-    input->relMouse = {};
-    for(int keyIdx = 0; keyIdx < MAX_KEYCODES; keyIdx++)
+    // Playbacks only take the recorded GameInput, live Keys, Mouse Editing
+    // and UI Buttons would change the GameState behind the Replay's back.
+    // Replay Controls are handled before the Ticks in update_replay()
+    Input* liveInput = input;
+    Input idleInput = {};
+    if(replayState->mode == REPLAY_MODE_PLAYBACK)
     {
-      input->keys[keyIdx].justReleased = false;
-      input->keys[keyIdx].justPressed = false;
-      input->keys[keyIdx].halfTransitionCount = 0;
+      input = &idleInput;
     }
+    update();
+    input = liveInput;
+    reset_input();
   }
   float interpolatedDT = (float)(gameState->updateTimer / UPDATE_DELAY);
   draw(interpolatedDT);
@@ -220,48 +244,345 @@ EXPORT_FN void update_game(GameState* gameStateIn, Input* inputIn, RenderData* r
 // #############################################################################
 //                           Implementations Input
 // #############################################################################
-void update_game_input(float dt)
+// The Keys behind every GameInput, before any Buffering.
+// Replays record and play back these
+void sample_game_input(GameInput* sampled)
 {
   // Moving
-  gameState->gameInput[INPUT_MOVE_LEFT].isDown = input->keys[KEY_A].isDown;
-  gameState->gameInput[INPUT_MOVE_RIGHT].isDown = input->keys[KEY_D].isDown;
-  gameState->gameInput[INPUT_MOVE_UP].isDown = input->keys[KEY_W].isDown;
-  gameState->gameInput[INPUT_MOVE_DOWN].isDown = input->keys[KEY_S].isDown;
-  gameState->gameInput[INPUT_MOVE_LEFT].isDown |= input->keys[KEY_LEFT].isDown;
-  gameState->gameInput[INPUT_MOVE_RIGHT].isDown |= input->keys[KEY_RIGHT].isDown;
-  gameState->gameInput[INPUT_MOVE_UP].isDown |= input->keys[KEY_UP].isDown;
-  gameState->gameInput[INPUT_MOVE_DOWN].isDown |= input->keys[KEY_DOWN].isDown;
+  sampled[INPUT_MOVE_LEFT].isDown = input->keys[KEY_A].isDown;
+  sampled[INPUT_MOVE_RIGHT].isDown = input->keys[KEY_D].isDown;
+  sampled[INPUT_MOVE_UP].isDown = input->keys[KEY_W].isDown;
+  sampled[INPUT_MOVE_DOWN].isDown = input->keys[KEY_S].isDown;
+  sampled[INPUT_MOVE_LEFT].isDown |= input->keys[KEY_LEFT].isDown;
+  sampled[INPUT_MOVE_RIGHT].isDown |= input->keys[KEY_RIGHT].isDown;
+  sampled[INPUT_MOVE_UP].isDown |= input->keys[KEY_UP].isDown;
+  sampled[INPUT_MOVE_DOWN].isDown |= input->keys[KEY_DOWN].isDown;
+
+  // Jumping
+  sampled[INPUT_JUMP].isDown = input->keys[KEY_SPACE].isDown;
+  sampled[INPUT_JUMP].justPressed = input->keys[KEY_SPACE].justPressed;
+
+  // Wall Grabbing
+  sampled[INPUT_WALL_GRAB].isDown = input->keys[KEY_E].isDown;
+  sampled[INPUT_WALL_GRAB].isDown |= input->keys[KEY_Q].isDown;
+
+  // Dashing
+  sampled[INPUT_DASH].justPressed  = input->keys[KEY_Q].justPressed;
+  sampled[INPUT_DASH].justPressed |= input->keys[KEY_E].justPressed;
+  sampled[INPUT_DASH].justPressed |= input->keys[KEY_C].justPressed;
+}
+
+void update_game_input(float dt)
+{
+  GameInput sampled[GAME_INPUT_COUNT] = {};
+
+  // Replays replace the live Keys Tick by Tick
+  if(replayState->mode == REPLAY_MODE_PLAYBACK)
+  {
+    if(!replay_play_tick(sampled))
+    {
+      stop_replay_playback();
+      sample_game_input(sampled);
+    }
+    // Stop right after the last Tick, not one live Tick later
+    else if(replayState->tick == replayState->tickCount)
+    {
+      stop_replay_playback();
+    }
+  }
+  else
+  {
+    sample_game_input(sampled);
+  }
+
+  if(replayState->mode == REPLAY_MODE_RECORDING && 
+     !replay_record_tick(sampled))
+  {
+    SM_WARN("Replay Input full, stopping the Recording");
+    stop_replay_recording(transientStorage);
+  }
+
+  for(int inputIdx = 0; inputIdx < GAME_INPUT_COUNT; inputIdx++)
+  {
+    gameState->gameInput[inputIdx].isDown = sampled[inputIdx].isDown;
+  }
 
   // Jumping
   GameInput* jumpInput  = &gameState->gameInput[INPUT_JUMP];
   jumpInput->bufferingTime = max(0.0f, jumpInput->bufferingTime - dt);
-  if(input->keys[KEY_SPACE].justPressed)
+  if(sampled[INPUT_JUMP].justPressed)
   {
-    gameState->gameInput[INPUT_JUMP].justPressed = true;
-    gameState->gameInput[INPUT_JUMP].bufferingTime = 0.125f;
+    jumpInput->justPressed = true;
+    jumpInput->bufferingTime = 0.125f;
   }
 
-  if(gameState->gameInput[INPUT_JUMP].bufferingTime == 0.0f)
+  if(jumpInput->bufferingTime == 0.0f)
   {
-    jumpInput->justPressed = input->keys[KEY_SPACE].justPressed;
+    jumpInput->justPressed = sampled[INPUT_JUMP].justPressed;
   }
 
-  gameState->gameInput[INPUT_JUMP].isDown = 
-    input->keys[KEY_SPACE].isDown;
+  // Dashing
+  gameState->gameInput[INPUT_DASH].justPressed = sampled[INPUT_DASH].justPressed;
+}
 
-  // Wall Grabbing
-  gameState->gameInput[INPUT_WALL_GRAB].isDown =
-    input->keys[KEY_E].isDown;
-  gameState->gameInput[INPUT_WALL_GRAB].isDown |=
-    input->keys[KEY_Q].isDown;
+void reset_input()
+{
+  // input->wheelDelta = 0;
+  input->relMouse = {};
+  for(int keyIdx = 0; keyIdx < MAX_KEYCODES; keyIdx++)
+  {
+    input->keys[keyIdx].justReleased = false;
+    input->keys[keyIdx].justPressed = false;
+    input->keys[keyIdx].halfTransitionCount = 0;
+  }
+}
 
-  // Dashing
-  gameState->gameInput[INPUT_DASH].justPressed  = input->keys[KEY_Q].justPressed;
-  gameState->gameInput[INPUT_DASH].justPressed  = input->keys[KEY_E].justPressed;
-  gameState->gameInput[INPUT_DASH].justPressed  = input->keys[KEY_C].justPressed;
-  gameState->gameInput[INPUT_DASH].justPressed |= input->keys[KEY_Q].justPressed;
-  gameState->gameInput[INPUT_DASH].justPressed |= input->keys[KEY_E].justPressed;
-  gameState->gameInput[INPUT_DASH].justPressed |= input->keys[KEY_C].justPressed;
+// Runs once per Frame before the Ticks, so Recordings start and
+// Playbacks restore the GameState at a Tick boundary. The Keys are
+// consumed, Frames without a Tick would see them again otherwise
+void update_replay()
+{
+  if(key_consume_press(KEY_F7))
+  {
+    check_replay();
+  }
+
+  if(key_consume_press(KEY_F5))
+  {
+    if(replayState->mode == REPLAY_MODE_RECORDING)
+    {
+      stop_replay_recording(transientStorage);
+    }
+    else
+    {
+      request_replay(REPLAY_MODE_RECORDING, "replay.bin");
+    }
+  }
+
+  if(key_consume_press(KEY_F6))
+  {
+    request_replay(REPLAY_MODE_PLAYBACK, "replay.bin");
+  }
+
+  if(replayState->mode == REPLAY_MODE_PLAYBACK)
+  {
+    if(key_consume_press(KEY_PAGE_UP))
+    {
+      request_replay_seek(replayState->tick - REPLAY_SEEK_TICKS);
+    }
+
+    if(key_consume_press(KEY_PAGE_DOWN))
+    {
+      request_replay_seek(replayState->tick + REPLAY_SEEK_TICKS);
+    }
+  }
+
+  ReplayMode requestedMode = replayState->requestedMode;
+  replayState->requestedMode = REPLAY_MODE_OFF;
+  if(requestedMode != REPLAY_MODE_OFF)
+  {
+    if(replayState->mode == REPLAY_MODE_RECORDING)
+    {
+      stop_replay_recording(transientStorage);
+    }
+    if(replayState->mode == REPLAY_MODE_PLAYBACK)
+    {
+      stop_replay_playback();
+    }
+
+    if(requestedMode == REPLAY_MODE_RECORDING)
+    {
+      start_replay_recording(replayState->requestedPath, gameState);
+    }
+    else if(start_replay_playback(replayState->requestedPath, gameState))
+    {
+      // Recorded before the Replay, nothing to go back to
+      rewind_discard(rewind_frame_count());
+    }
+  }
+
+  // After the Playback started, a Seek can come in the same Frame
+  if(replayState->seekRequested)
+  {
+    replayState->seekRequested = false;
+    if(replayState->mode == REPLAY_MODE_PLAYBACK)
+    {
+      seek_replay(replayState->seekTick);
+    }
+  }
+}
+
+// Restores the last Keyframe before the Tick and simulates the rest,
+// at most REPLAY_KEYFRAME_INTERVAL Ticks
+void seek_replay(int tick)
+{
+  long long startUs = get_time_us();
+
+  // The Frame's own Tick plays the last one and ends the Playback
+  tick = clamp(tick, 0, max(replayState->tickCount - 1, 0));
+  int keyframeTick = replay_restore_keyframe(gameState, tick);
+
+  // Live Keys would count once per simulated Tick, Sounds would all play
+  // at once and the Rewind Frames get discarded right after
+  Input* liveInput = input;
+  Input idleInput = {};
+  input = &idleInput;
+  replayState->seeking = true;
+  bool wasMuted = soundState->muted;
+  soundState->muted = true;
+  while(replayState->mode == REPLAY_MODE_PLAYBACK && replayState->tick < tick)
+  {
+    update();
+  }
+  soundState->muted = wasMuted;
+  replayState->seeking = false;
+  input = liveInput;
+
+  // Recorded before the Seek, nothing to go back to
+  rewind_discard(rewind_frame_count());
+
+  replayState->seekSimulatedTicks = tick - keyframeTick;
+  replayState->seekMs = (get_time_us() - startUs) / 1000.0;
+  SM_TRACE("Replay Seek to Tick %d: Keyframe at Tick %d, %d Ticks simulated in %.2f ms",
+           tick, keyframeTick, replayState->seekSimulatedTicks, replayState->seekMs);
+}
+
+// F7, records scripted Input from a Copy of the GameState, tries to edit
+// the Level halfway and plays the Recording back like update_game() does,
+// without live Keys. Both have to end in the same GameState. Then Page Down
+// is held over two Frames without a Tick, it has to seek exactly one Step.
+// The Session, its Replay and its Rewind Frames are left alone
+bool check_replay()
+{
+  constexpr int CHECK_REPLAY_SEEK_START = UPDATES_PER_SECOND;
+  constexpr int CHECK_REPLAY_SEEK_TICK = CHECK_REPLAY_SEEK_START + REPLAY_SEEK_TICKS;
+  constexpr int CHECK_REPLAY_TICKS = CHECK_REPLAY_SEEK_TICK + REPLAY_KEYFRAME_INTERVAL;
+  constexpr int CHECK_REPLAY_EDIT_TICK = REPLAY_KEYFRAME_INTERVAL / 2;
+  char checkPath[] = "replay_check.bin";
+
+  TempArena temp(transientStorage);
+  GameState* recordedState = (GameState*)bump_alloc(transientStorage, sizeof(GameState),
+                                                    ALLOC_TAG_GAME);
+  GameState* seekState = (GameState*)bump_alloc(transientStorage, sizeof(GameState),
+                                                ALLOC_TAG_GAME);
+  GameState* checkGameState = (GameState*)bump_alloc(transientStorage, sizeof(GameState),
+                                                     ALLOC_TAG_GAME);
+  Input* checkInput = (Input*)bump_alloc(transientStorage, sizeof(Input), ALLOC_TAG_GAME);
+  UIState* checkUIState = (UIState*)bump_alloc(transientStorage, sizeof(UIState), ALLOC_TAG_UI);
+  RewindState* checkRewindState = (RewindState*)bump_alloc(transientStorage, sizeof(RewindState),
+                                                           ALLOC_TAG_GAME);
+  ReplayState* checkReplayState = (ReplayState*)bump_alloc(transientStorage, sizeof(ReplayState),
+                                                           ALLOC_TAG_GAME);
+  if(!checkReplayState)
+  {
+    SM_ERROR("Replay Check: Failed to allocate the Copy");
+    return false;
+  }
+
+  memcpy(checkGameState, gameState, sizeof(GameState));
+  checkGameState->state = GAME_STATE_IN_LEVEL;
+  memcpy(checkInput, input, sizeof(Input));
+  memcpy(checkUIState, uiState, sizeof(UIState));
+  memset((void*)checkRewindState, 0, sizeof(RewindState));
+  memset((void*)checkReplayState, 0, sizeof(ReplayState));
+
+  GameState* liveGameState = gameState;
+  Input* liveInput = input;
+  UIState* liveUIState = uiState;
+  RewindState* liveRewindState = rewindState;
+  ReplayState* liveReplayState = replayState;
+  bool liveMuted = soundState->muted;
+  gameState = checkGameState;
+  input = checkInput;
+  uiState = checkUIState;
+  rewindState = checkRewindState;
+  replayState = checkReplayState;
+  soundState->muted = true;
+
+  // Runs right and jumps every Second. Halfway it resets the Solids,
+  // teleports and places a Tile under the Mouse, none of it is recorded
+  start_replay_recording(checkPath, gameState);
+  while(replayState->mode == REPLAY_MODE_RECORDING && 
+        replayState->tickCount < CHECK_REPLAY_TICKS)
+  {
+    int tick = replayState->tickCount;
+    memset(input->keys, 0, sizeof(input->keys));
+    input->keys[KEY_D].isDown = true;
+    if(tick % UPDATES_PER_SECOND == 0)
+    {
+      input->keys[KEY_SPACE] = {.isDown = true, .justPressed = true, .halfTransitionCount = 1};
+    }
+    if(tick == CHECK_REPLAY_EDIT_TICK)
+    {
+      input->keys[KEY_1] = {.isDown = true, .justPressed = true, .halfTransitionCount = 1};
+      input->keys[KEY_R] = {.isDown = true, .justPressed = true, .halfTransitionCount = 1};
+      input->keys[KEY_MOUSE_LEFT] = {.isDown = true, .justPressed = true, 
+                                     .halfTransitionCount = 1};
+      input->mousePos = {(int)input->screenSize.x / 2, (int)input->screenSize.y / 2};
+    }
+
+    update();
+    reset_input();
+  }
+  bool passed = replayState->tickCount == CHECK_REPLAY_TICKS &&
+                stop_replay_recording(transientStorage);
+  memcpy(recordedState, gameState, sizeof(GameState));
+
+  // Playbacks never see live Keys, see update_game()
+  memset(input->keys, 0, sizeof(input->keys));
+  passed &= start_replay_playback(checkPath, gameState);
+  bool seekStateCaptured = false;
+  while(replayState->mode == REPLAY_MODE_PLAYBACK)
+  {
+    update();
+    reset_input();
+
+    // Seeks stop right after the Update that played their Tick
+    if(!seekStateCaptured && replayState->tick == CHECK_REPLAY_SEEK_TICK)
+    {
+      memcpy(seekState, gameState, sizeof(GameState));
+      seekStateCaptured = true;
+    }
+  }
+  passed &= replayState->tick == CHECK_REPLAY_TICKS &&
+            !memcmp(gameState, recordedState, sizeof(GameState));
+
+  passed &= seekStateCaptured && start_replay_playback(checkPath, gameState);
+  while(passed && replayState->tick < CHECK_REPLAY_SEEK_START)
+  {
+    update();
+    reset_input();
+  }
+  input->keys[KEY_PAGE_DOWN] = {.isDown = true, .justPressed = true, .halfTransitionCount = 1};
+  update_replay();
+  update_replay();
+  passed &= replayState->mode == REPLAY_MODE_PLAYBACK &&
+            replayState->tick == CHECK_REPLAY_SEEK_TICK &&
+            !memcmp(gameState, seekState, sizeof(GameState));
+  stop_replay_playback();
+
+  gameState = liveGameState;
+  input = liveInput;
+  uiState = liveUIState;
+  rewindState = liveRewindState;
+  replayState = liveReplayState;
+  soundState->muted = liveMuted;
+
+  if(!passed)
+  {
+    SM_ERROR("Replay Check: Playback or Seek doesn't match the Recording");
+    return false;
+  }
+  SM_TRACE("Replay Check: %d Ticks recorded with Edits, played back and seeked from "
+           "Tick %d to %d", CHECK_REPLAY_TICKS, CHECK_REPLAY_SEEK_START, CHECK_REPLAY_SEEK_TICK);
+  return true;
+}
+
+// Only the GameInput is recorded, Edits, Loads and Menus would change the
+// GameState behind the Replay's back. They are off while a Replay runs
+bool editing_allowed()
+{
+  return replayState->mode == REPLAY_MODE_OFF;
 }
 
 bool is_down(GameInputType type)
@@ -395,18 +716,17 @@ void update_player(float dt)
   float wallSlideDownSpeed = 2.2f;
   float directionChangeMult = 1.6f;
 
-  // Static variables that keep the state of the data
-  // Other functions don't need access to this data
-  // which is why it's here
-  static Vec2 speed;
-  static float xRemainder;
-  static float yRemainder;
-  static float varJumpTimer;
-  static float wallJumpTimer;
-  static float dashTimer;
-  static bool playerGrounded = true;
-  static bool grabbingWall = false;
-  static int dashCounter = playerGrounded;
+  // Movement State lives in the Player, Rewind and Replays restore it
+  // along with everything else. Other functions don't need access to it
+  Vec2& speed = gameState->player.speed;
+  float& xRemainder = gameState->player.remainder.x;
+  float& yRemainder = gameState->player.remainder.y;
+  float& varJumpTimer = gameState->player.varJumpTimer;
+  float& wallJumpTimer = gameState->player.wallJumpTimer;
+  float& dashTimer = gameState->player.dashTimer;
+  bool& playerGrounded = gameState->player.grounded;
+  bool& grabbingWall = gameState->player.grabbingWall;
+  int& dashCounter = gameState->player.dashCounter;
 
   gameState->player.prevPos = gameState->player.pos;
   gameState->player.animationState = ANIMATION_STATE_IDLE;
@@ -448,6 +768,10 @@ void update_player(float dt)
       else
       {
         gameState->player.runAnimTimer += dt;
+        if(gameState->player.runAnimTimer > RUN_ANIM_TIME)
+        {
+          gameState->player.runAnimTimer -= RUN_ANIM_TIME;
+        }
         gameState->player.animationState = ANIMATION_STATE_RUN;
       }
 
@@ -478,6 +802,10 @@ void update_player(float dt)
       else
       {
         gameState->player.runAnimTimer += dt;
+        if(gameState->player.runAnimTimer > RUN_ANIM_TIME)
+        {
+          gameState->player.runAnimTimer -= RUN_ANIM_TIME;
+        }
         gameState->player.animationState = ANIMATION_STATE_RUN;
       }
 
@@ -898,7 +1226,7 @@ void update_player(float dt)
                     spikeCollision = true;
                     gameState->player.deathAnimTimer = 0.0f;
                     speed = normalize(-speed) * dashSpeed;
-                    play_sound(gameState->deathSound);
+                    play_sound(gameState->deathSound, 0, 1.0f, SOUND_PRIORITY_HIGH);
                   }
                   goto handle_collision;
                 }
@@ -997,7 +1325,7 @@ void update_player(float dt)
                     spikeCollision = true;
                     gameState->player.deathAnimTimer = 0.0f;
                     speed = normalize(-speed) * dashSpeed;
-                    play_sound(gameState->deathSound);
+                    play_sound(gameState->deathSound, 0, 1.0f, SOUND_PRIORITY_HIGH);
                   }
 
                   collisionHappened = true;
@@ -1142,6 +1470,8 @@ void draw_tile_map(TileMap* tileMap)
 
 void draw(float interpDT)
 {
+  renderData->gameCamera.position = gameState->cameraPos;
+
   Vec4 clearColor = {79.0f / 255.0f, 140.0f / 255.0f, 235.0f / 255.0f, 1.0f};
   renderData->clearColor = clearColor * (renderData->gameCamera.position.y / ((float)ROOM_HEIGHT * 100.0f));
 
@@ -1171,12 +1501,27 @@ void draw(float interpDT)
                           position.y + dimensions.y / 2.0f);
   }
  
-  // Draw UI
+  // Draw UI, only Widgets submitted during the last tick
   {
     for(int eleIdx = 0; eleIdx < uiState->uiElements.count; eleIdx++)
     {
-      UIElement uiElement = uiState->uiElements[eleIdx];
-      draw_ui_sprite(uiElement.spriteID, uiElement.pos);
+      UIElement* uiElement = &uiState->uiElements[eleIdx];
+      if(uiElement->lastTick == uiState->tick)
+      {
+        draw_ui_quad(uiElement->transform);
+      }
+    }
+
+    for(int textIdx = 0; textIdx < uiState->texts.count; textIdx++)
+    {
+      UIText* uiText = &uiState->texts[textIdx];
+      if(uiText->lastTick == uiState->tick)
+      {
+        for(int charIdx = 0; charIdx < uiText->transforms.count; charIdx++)
+        {
+          draw_ui_quad(uiText->transforms[charIdx]);
+        }
+      }
     }
   }
 
@@ -1243,7 +1588,9 @@ void draw(float interpDT)
           {  
             SpriteID spriteID = gameState->player.animationSprites[gameState->player.animationState];
             Sprite sprite = get_sprite(spriteID);
-            int animationIdx = animate(&gameState->player.runAnimTimer, sprite.frameCount, 0.5f);
+            // Wrapped in update_player(), Drawing mustn't change the GameState
+            float t = gameState->player.runAnimTimer;
+            int animationIdx = animate(&t, sprite.frameCount, RUN_ANIM_TIME);
             draw_quad(playerPos, vec_2(1.0f));
             draw_sprite(spriteID, playerPos, 
                         {
@@ -1265,7 +1612,7 @@ void update_level(float dt)
   update_player(dt);
 
   // Change Solids
-  if(key_pressed_this_frame(KEY_1))
+  if(editing_allowed() && key_pressed_this_frame(KEY_1))
   {
     gameState->level.solids.clear();
 
@@ -1294,40 +1641,54 @@ void update_level(float dt)
 
   }
 
-  if(key_pressed_this_frame(KEY_R))
+  if(editing_allowed() && key_pressed_this_frame(KEY_R))
   {
     // gameState->player.pos = gameState->level.playerStartPos;
     gameState->player.pos = {-18 * 8, - 60 * 8};
   }
 
-  if(do_button(SPRITE_SAVE_BUTTON, {WORLD_WIDTH - 20, 12}, line_id(1)))
+  if(editing_allowed() && do_button(SPRITE_SAVE_BUTTON, {WORLD_WIDTH - 20, 12}, line_id(1)))
+  {
+    queue_level_save("level.bin", &gameState->level);
+  }
+
+  // Saves are written in the Background, show how the last one went
+  if(saveState->resultTimer > 0.0f)
   {
-    write_file("level.bin", (char*)&gameState->level, sizeof(Level));
+    SaveStatus status = get_save_status();
+    if(!save_in_flight())
+    {
+      saveState->resultTimer -= dt;
+    }
+
+    const char* statusText = status == SAVE_STATUS_FAILED? "Save failed" :
+                             status == SAVE_STATUS_DONE? "Saved" : "Saving...";
+    do_ui_text(statusText, {WORLD_WIDTH - 80, 8}, line_id(1));
   }
 
 
-  if(key_pressed_this_frame(KEY_ESCAPE))
+  if(editing_allowed() && key_pressed_this_frame(KEY_ESCAPE))
   {
     gameState->state = GAME_STATE_MAIN_MENU;
   }
 
-  if(key_pressed_this_frame(KEY_K))
+  if(editing_allowed() && key_pressed_this_frame(KEY_K))
   {
-    write_file("gamestate.bin", (char*)gameState, sizeof(GameState));
+    queue_game_state_save("gamestate.bin", gameState);
   }
 
-  if(key_pressed_this_frame(KEY_L))
+  if(key_pressed_this_frame(KEY_F9))
   {
-    int fileSize;
-    GameState* emulatedState = (GameState*)read_file("gamestate.bin", &fileSize, transientStorage);
-    SM_ASSERT(sizeof(GameState) == fileSize, "Penis");
-    if(emulatedState)
-    {
-      *gameState = *emulatedState;
-    }
+    bench_resampler(transientStorage);
+  }
+
+  if(editing_allowed() && key_pressed_this_frame(KEY_L))
+  {
+    load_game_state_file("gamestate.bin", gameState, transientStorage);
   }
 
   // Leveleditor
+  if(editing_allowed())
   {
     if(!ui_is_hot() && key_is_down(KEY_MOUSE_LEFT))
     {
@@ -1522,22 +1883,29 @@ void update()
   // and to save on performance
   float dt = UPDATE_DELAY;
 
+  // Seeks restore Keyframes and run update() from there, so they have to be
+  // taken before the Camera below moves
+  if(replayState->mode == REPLAY_MODE_RECORDING)
+  {
+    replay_update_keyframe(gameState);
+  }
+
   // Update Camera
   {
-    static Vec2 camEndPos = renderData->gameCamera.position;
-    static Vec2 camStartPos = renderData->gameCamera.position;
-    static float t = 0.0f;
+    Vec2& camEndPos = gameState->cameraEndPos;
+    Vec2& camStartPos = gameState->cameraStartPos;
+    float& t = gameState->cameraTimer;
 
     // Camera Position is a multiple of 180(Room Height)
     {
-      if(camEndPos.y != renderData->gameCamera.position.y)
+      if(camEndPos.y != gameState->cameraPos.y)
       {
         if(t == 1.0f)
         {
           t = 0.0f;
         }
         t = min(t + dt, 1.0f);
-        renderData->gameCamera.position = lerp(camStartPos, camEndPos, ease_out_quad(t));
+        gameState->cameraPos = lerp(camStartPos, camEndPos, ease_out_quad(t));
         return;
       }
 
@@ -1545,16 +1913,16 @@ void update()
       camStartPos = camEndPos;
       int roomIdx = get_room_idx();
       camEndPos.y = 90.0f + 176.0f * (float)roomIdx;
-      camEndPos.x = renderData->gameCamera.position.x;
+      camEndPos.x = gameState->cameraPos.x;
 
-      if(key_pressed_this_frame(KEY_H))
+      if(editing_allowed() && key_pressed_this_frame(KEY_H))
       {
-        renderData->gameCamera.position.y -= 1.0f;
+        gameState->cameraPos.y -= 1.0f;
       }
 
-      if(key_pressed_this_frame(KEY_J))
+      if(editing_allowed() && key_pressed_this_frame(KEY_J))
       {
-        renderData->gameCamera.position.y += 1.0f;
+        gameState->cameraPos.y += 1.0f;
       }
     } 
 
@@ -1572,11 +1940,26 @@ void update()
   update_game_input(dt);
   update_ui();
 
+  if(replayState->mode == REPLAY_MODE_RECORDING)
+  {
+    do_format_ui_text("Recording %.1fs", {8, 20}, line_id(1), replayState->tickCount * dt);
+  }
+  else if(replayState->mode == REPLAY_MODE_PLAYBACK)
+  {
+    do_format_ui_text("Replay %d / %d", {8, 20}, line_id(1), replayState->tick,
+                      replayState->tickCount);
+    if(replayState->seekMs > 0.0)
+    {
+      do_format_ui_text("Seek %.2f ms, %d Ticks", {8, 32}, line_id(1), replayState->seekMs,
+                        replayState->seekSimulatedTicks);
+    }
+  }
+
   switch(gameState->state)
   {
     case GAME_STATE_MAIN_MENU:
     {
-      if(do_button(SPRITE_PLAY_BUTTON, {160, 90}, line_id(1)))
+      if(editing_allowed() && do_button(SPRITE_PLAY_BUTTON, {160, 90}, line_id(1)))
       {
         gameState->state = GAME_STATE_IN_LEVEL;
       }
@@ -1585,7 +1968,29 @@ void update()
 
     case GAME_STATE_IN_LEVEL:
     {
+      // Holding Backspace steps back one recorded Tick per Tick,
+      // letting go carries on from there. Replays can't be rewound
+      if(key_is_down(KEY_BACKSPACE) && rewind_frame_count() > 1 &&
+         replayState->mode == REPLAY_MODE_OFF)
+      {
+        rewind_discard(1);
+
+        // The Update Loop is still running on this Timer
+        double updateTimer = gameState->updateTimer;
+        rewind_restore(gameState, 0);
+        gameState->updateTimer = updateTimer;
+
+        do_format_ui_text("Rewind %.1fs, %d KB, %.3f ms", {8, 8}, line_id(1),
+                          rewind_frame_count() * dt, rewind_used_bytes() / 1024,
+                          rewindState->restoreMs);
+        break;
+      }
+
       update_level(dt);
+      if(!replayState->seeking)
+      {
+        rewind_record(gameState, transientStorage);
+      }
       break;
     }
   }
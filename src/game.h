@@ -48,7 +48,9 @@ enum TileType
 {
   TILE_TYPE_NONE,
   TILE_TYPE_SOLID,
-  TILE_TYPE_SPIKE
+  TILE_TYPE_SPIKE,
+
+  TILE_TYPE_COUNT
 };
 
 struct Tile
@@ -76,6 +78,16 @@ struct Player
   float runAnimTimer;
   AnimationState animationState;
   SpriteID animationSprites[ANIMATION_STATE_COUNT]; 
+
+  // Movement, owned by update_player()
+  Vec2 speed;
+  Vec2 remainder;
+  float varJumpTimer;
+  float wallJumpTimer;
+  float dashTimer;
+  bool grounded;
+  bool grabbingWall;
+  int dashCounter;
 };
 
 struct Tileset
@@ -122,7 +134,7 @@ struct Level
   IVec2 playerStartPos;
   TileMap tileMap;
   TileMap bgTileMap;
-  Array<Solid, 50> solids;
+  Pool<Solid, 50> solids;
 };
 
 enum GameStateID
@@ -137,14 +149,19 @@ struct GameState
 
   double updateTimer;
   bool initialized = false;
+
+  // Room Transitions pause the Game, so the Camera is Game State too
+  Vec2 cameraPos;
+  Vec2 cameraStartPos;
+  Vec2 cameraEndPos;
   float cameraTimer;
   GameInput gameInput[GAME_INPUT_COUNT];
 
   Player player;
   Level level;
 
-  Sound jumpSound;
-  Sound deathSound;
+  SoundHandle jumpSound;
+  SoundHandle deathSound;
 };
 
 // #############################################################################
@@ -155,11 +172,18 @@ static GameState* gameState;
 // #############################################################################
 //                           Game Functions (Exposed)
 // #############################################################################
+// Live in level_file.h, rewind.h and replay.h
+struct SaveState;
+struct RewindState;
+struct ReplayState;
+
 extern "C"
 {
   EXPORT_FN void update_game(GameState* gameStateIn, Input* inputIn, RenderData* renderDataIn,
                              SoundState* soundStateIn, UIState* uiStateIn, 
-                             BumpAllocator* transientStorageIn, float frameTime);
+                             SaveState* saveStateIn, RewindState* rewindStateIn,
+                             ReplayState* replayStateIn, BumpAllocator* transientStorageIn,
+                             float frameTime);
 }
 
 
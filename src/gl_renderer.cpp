@@ -138,9 +138,11 @@ static void APIENTRY gl_debug_callback(GLenum source, GLenum type, GLuint id, GL
 
 GLuint gl_create_shader(int shaderType, char* shaderPath, BumpAllocator* transientStorage)
 {
+  TempArena temp(transientStorage);
   int fileSize = 0;
-  char* shaderHeader = read_file("src/shader_header.h", &fileSize, transientStorage);
-  char* shaderSource = read_file(shaderPath, &fileSize, transientStorage);
+  char* shaderHeader = read_file("src/shader_header.h", &fileSize, transientStorage, 
+                                 ALLOC_TAG_RENDER);
+  char* shaderSource = read_file(shaderPath, &fileSize, transientStorage, ALLOC_TAG_RENDER);
   if(!shaderHeader)
   {
     SM_ASSERT(false, "Failed to load shader_header.h");
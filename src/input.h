@@ -130,3 +130,17 @@ bool key_released_this_frame(KeyCodeID key)
   Key k = input->keys[key];
   return k.halfTransitionCount > 0 && !k.isDown || k.halfTransitionCount > 1;
 }
+
+// For Keys handled once per Frame instead of once per Tick. Transitions are
+// only cleared after a Tick, a Frame without one would see the Press again
+bool key_consume_press(KeyCodeID key)
+{
+  if(!key_pressed_this_frame(key))
+  {
+    return false;
+  }
+
+  input->keys[key].halfTransitionCount = 0;
+  input->keys[key].justPressed = false;
+  return true;
+}
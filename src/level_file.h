@@ -0,0 +1,884 @@
+#pragma once
+#include "game.h"
+
+// Used to get offsetof
+#include <stddef.h>
+
+// #############################################################################
+//                           Level File Constants
+// #############################################################################
+// A Header followed by Chunks, every Chunk has an ID, a Version and a Size,
+// so unknown Chunks can be skipped. Fields are written one by one, Struct
+// changes don't break old Files. Tile Layers are run length encoded
+#define FOURCC(a, b, c, d) ((unsigned int)(a) | (b) << 8 | (c) << 16 | (d) << 24)
+
+static constexpr unsigned int LEVEL_FILE_MAGIC = FOURCC('S', 'M', 'L', 'V');
+static constexpr int LEVEL_FILE_VERSION = 1;
+
+// Encoded Files never get close to this, it's the raw GameState plus slack
+static constexpr int MAX_LEVEL_FILE_SIZE = sizeof(GameState) + KB(64);
+
+enum LevelChunkID : unsigned int
+{
+  LEVEL_CHUNK_INFO = FOURCC('I', 'N', 'F', 'O'), // Player Start, World Size
+  LEVEL_CHUNK_TILESET = FOURCC('T', 'S', 'E', 'T'), // One per Layer
+  LEVEL_CHUNK_TILES = FOURCC('T', 'I', 'L', 'E'), // One per Layer, RLE Tile Types
+  LEVEL_CHUNK_SOLIDS = FOURCC('S', 'O', 'L', 'D'),
+  LEVEL_CHUNK_GAME_STATE = FOURCC('G', 'A', 'M', 'E'), // RLE GameState without the Level
+  LEVEL_CHUNK_REPLAY_STATE = FOURCC('R', 'P', 'S', 'T'), // RLE GameState a Replay starts from
+  LEVEL_CHUNK_REPLAY_INPUT = FOURCC('R', 'P', 'I', 'N'), // Bit packed GameInput per Tick
+  LEVEL_CHUNK_REPLAY_KEYFRAMES = FOURCC('R', 'P', 'K', 'F'), // RLE GameStates to seek to
+  LEVEL_CHUNK_REPLAY_INDEX = FOURCC('R', 'P', 'I', 'X'), // Last Chunk, where the Keyframes are
+};
+
+// Chunk Versions, bump when the Payload changes
+static constexpr int LEVEL_CHUNK_VERSION = 1;
+
+enum LevelLayer
+{
+  LEVEL_LAYER_FOREGROUND,
+  LEVEL_LAYER_BACKGROUND,
+
+  LEVEL_LAYER_COUNT
+};
+
+static constexpr int ALL_LEVEL_LAYERS = (1 << LEVEL_LAYER_COUNT) - 1;
+
+// #############################################################################
+//                           Level File Structs
+// #############################################################################
+struct LevelFileHeader
+{
+  unsigned int magic;
+  int version;
+  int chunkCount;
+};
+
+struct LevelChunkHeader
+{
+  unsigned int id;
+  int version;
+  int size; // Payload Bytes after this Header
+};
+
+struct LevelWriter
+{
+  char* data;
+  int capacity;
+  int used;
+  bool overflow;
+
+  int chunkCount;
+  int chunkStart;
+};
+
+struct LevelReader
+{
+  char* data;
+  int size;
+  int used;
+  bool overflow;
+};
+
+// #############################################################################
+//                           Run Length Encoding
+// #############################################################################
+// PackBits, a Control Byte below 128 is followed by Control + 1 literal
+// Bytes, 128 and up repeats the next Byte Control - 126 times
+int rle_max_encoded_size(int size)
+{
+  return size + (size + 127) / 128;
+}
+
+int rle_encode(unsigned char* src, int size, unsigned char* dst)
+{
+  int srcIdx = 0;
+  int dstIdx = 0;
+  while(srcIdx < size)
+  {
+    int runLength = 1;
+    while(srcIdx + runLength < size && runLength < 129 &&
+          src[srcIdx + runLength] == src[srcIdx])
+    {
+      runLength++;
+    }
+
+    if(runLength >= 2)
+    {
+      dst[dstIdx++] = (unsigned char)(runLength + 126);
+      dst[dstIdx++] = src[srcIdx];
+      srcIdx += runLength;
+      continue;
+    }
+
+    // Literals until the next Run of at least 3, a Run of 2 is not worth a break
+    int literalCount = 1;
+    while(srcIdx + literalCount < size && literalCount < 128)
+    {
+      unsigned char* next = src + srcIdx + literalCount;
+      if(srcIdx + literalCount + 2 < size && next[0] == next[1] && next[1] == next[2])
+      {
+        break;
+      }
+      literalCount++;
+    }
+
+    dst[dstIdx++] = (unsigned char)(literalCount - 1);
+    memcpy(dst + dstIdx, src + srcIdx, literalCount);
+    dstIdx += literalCount;
+    srcIdx += literalCount;
+  }
+
+  return dstIdx;
+}
+
+// Fails unless the Data decodes to exactly dstSize Bytes
+bool rle_decode(unsigned char* src, int size, unsigned char* dst, int dstSize)
+{
+  int srcIdx = 0;
+  int dstIdx = 0;
+  while(srcIdx < size)
+  {
+    int control = src[srcIdx++];
+    if(control < 128)
+    {
+      int literalCount = control + 1;
+      if(srcIdx + literalCount > size || dstIdx + literalCount > dstSize)
+      {
+        return false;
+      }
+      memcpy(dst + dstIdx, src + srcIdx, literalCount);
+      srcIdx += literalCount;
+      dstIdx += literalCount;
+    }
+    else
+    {
+      int runLength = control - 126;
+      if(srcIdx >= size || dstIdx + runLength > dstSize)
+      {
+        return false;
+      }
+      memset(dst + dstIdx, src[srcIdx++], runLength);
+      dstIdx += runLength;
+    }
+  }
+
+  return dstIdx == dstSize;
+}
+
+// #############################################################################
+//                           Level File Writing
+// #############################################################################
+char* level_write(LevelWriter* writer, void* data, int size)
+{
+  if(writer->overflow || writer->used + size > writer->capacity)
+  {
+    writer->overflow = true;
+    return nullptr;
+  }
+
+  char* dst = writer->data + writer->used;
+  if(data)
+  {
+    memcpy(dst, data, size);
+  }
+  writer->used += size;
+  return dst;
+}
+
+void level_write_int(LevelWriter* writer, int value)
+{
+  level_write(writer, &value, sizeof(value));
+}
+
+void level_write_float(LevelWriter* writer, float value)
+{
+  level_write(writer, &value, sizeof(value));
+}
+
+void level_write_ivec2(LevelWriter* writer, IVec2 value)
+{
+  level_write_int(writer, value.x);
+  level_write_int(writer, value.y);
+}
+
+void level_begin_chunk(LevelWriter* writer, LevelChunkID id)
+{
+  LevelChunkHeader header = {id, LEVEL_CHUNK_VERSION};
+  writer->chunkStart = writer->used;
+  level_write(writer, &header, sizeof(header));
+}
+
+void level_end_chunk(LevelWriter* writer)
+{
+  // RLE Payloads have odd Sizes, Headers are not aligned
+  if(!writer->overflow)
+  {
+    int size = writer->used - writer->chunkStart - sizeof(LevelChunkHeader);
+    memcpy(writer->data + writer->chunkStart + offsetof(LevelChunkHeader, size), &size, sizeof(size));
+  }
+  writer->chunkCount++;
+}
+
+// RLE Bytes go straight into the Writer, prefixed with their Size
+void level_write_rle(LevelWriter* writer, unsigned char* src, int size)
+{
+  char* sizeField = level_write(writer, nullptr, sizeof(int));
+  if(!sizeField || writer->used + rle_max_encoded_size(size) > writer->capacity)
+  {
+    writer->overflow = true;
+    return;
+  }
+
+  int encodedSize = rle_encode(src, size, (unsigned char*)writer->data + writer->used);
+  memcpy(sizeField, &encodedSize, sizeof(encodedSize));
+  writer->used += encodedSize;
+}
+
+void encode_level_chunks(LevelWriter* writer, Level* level)
+{
+  level_begin_chunk(writer, LEVEL_CHUNK_INFO);
+  level_write_ivec2(writer, level->playerStartPos);
+  level_write_ivec2(writer, WORLD_SIZE);
+  level_end_chunk(writer);
+
+  TileMap* layers[LEVEL_LAYER_COUNT] = {&level->tileMap, &level->bgTileMap};
+  for(int layer = 0; layer < LEVEL_LAYER_COUNT; layer++)
+  {
+    Tileset* tileset = &layers[layer]->tileset;
+    level_begin_chunk(writer, LEVEL_CHUNK_TILESET);
+    level_write_int(writer, layer);
+    level_write_int(writer, tileset->tileCoords.count);
+    for(int coordIdx = 0; coordIdx < tileset->tileCoords.count; coordIdx++)
+    {
+      level_write_ivec2(writer, tileset->tileCoords[coordIdx]);
+    }
+    level_end_chunk(writer);
+
+    // Only the Types, Neighbour Masks are recomputed every Frame
+    constexpr int TILE_COUNT = WORLD_SIZE.x * WORLD_SIZE.y;
+    unsigned char tileTypes[TILE_COUNT];
+    for(int tileIdx = 0; tileIdx < TILE_COUNT; tileIdx++)
+    {
+      tileTypes[tileIdx] = (unsigned char)layers[layer]->tiles[tileIdx].type;
+    }
+
+    level_begin_chunk(writer, LEVEL_CHUNK_TILES);
+    level_write_int(writer, layer);
+    level_write_rle(writer, tileTypes, TILE_COUNT);
+    level_end_chunk(writer);
+  }
+
+  level_begin_chunk(writer, LEVEL_CHUNK_SOLIDS);
+  level_write_int(writer, level->solids.count);
+  for(int solidIdx = 0; solidIdx < level->solids.count; solidIdx++)
+  {
+    Solid* solid = &level->solids[solidIdx];
+    level_write_int(writer, solid->spriteID);
+    level_write_ivec2(writer, solid->pos);
+    level_write_int(writer, solid->keyframes.count);
+    for(int keyframeIdx = 0; keyframeIdx < solid->keyframes.count; keyframeIdx++)
+    {
+      level_write_ivec2(writer, solid->keyframes[keyframeIdx].pos);
+      level_write_float(writer, solid->keyframes[keyframeIdx].time);
+    }
+  }
+
+  // The Pool Layout goes last, so Solid Handles survive a Save
+  level_write_int(writer, level->solids.slotCount);
+  for(int slotIdx = 0; slotIdx < level->solids.slotCount; slotIdx++)
+  {
+    level_write_int(writer, level->solids.denseToSlot[slotIdx]);
+    level_write_int(writer, level->solids.generations[slotIdx]);
+  }
+  level_end_chunk(writer);
+}
+
+void level_write_header(LevelWriter* writer)
+{
+  LevelFileHeader header = {LEVEL_FILE_MAGIC, LEVEL_FILE_VERSION};
+  level_write(writer, &header, sizeof(header));
+}
+
+void level_finish(LevelWriter* writer)
+{
+  if(!writer->overflow)
+  {
+    ((LevelFileHeader*)writer->data)->chunkCount = writer->chunkCount;
+  }
+}
+
+// Returns the encoded Size, 0 if it didn't fit into capacity
+int encode_level(Level* level, char* buffer, int capacity)
+{
+  LevelWriter writer = {buffer, capacity};
+  level_write_header(&writer);
+  encode_level_chunks(&writer, level);
+  level_finish(&writer);
+
+  return writer.overflow? 0 : writer.used;
+}
+
+// The Level goes into its own Chunks, the rest of the GameState is
+// stored as is, so it only loads into a Build with the same GameState
+int encode_game_state(GameState* state, char* buffer, int capacity, BumpAllocator* transientStorage)
+{
+  TempArena temp(transientStorage);
+  GameState* stateWithoutLevel = (GameState*)bump_alloc(transientStorage, sizeof(GameState),
+                                                        ALLOC_TAG_GAME);
+  if(!stateWithoutLevel)
+  {
+    return 0;
+  }
+  memcpy(stateWithoutLevel, state, sizeof(GameState));
+  stateWithoutLevel->level = {};
+
+  // The GameState Chunk comes first, the Level Chunks fill in the Level
+  LevelWriter writer = {buffer, capacity};
+  level_write_header(&writer);
+  level_begin_chunk(&writer, LEVEL_CHUNK_GAME_STATE);
+  level_write_int(&writer, sizeof(GameState));
+  level_write_rle(&writer, (unsigned char*)stateWithoutLevel, sizeof(GameState));
+  level_end_chunk(&writer);
+
+  encode_level_chunks(&writer, &state->level);
+  level_finish(&writer);
+
+  return writer.overflow? 0 : writer.used;
+}
+
+// #############################################################################
+//                           Level File Reading
+// #############################################################################
+char* level_read(LevelReader* reader, void* dst, int size)
+{
+  if(reader->overflow || size < 0 || reader->used + size > reader->size)
+  {
+    reader->overflow = true;
+    if(dst)
+    {
+      memset(dst, 0, size > 0? size : 0);
+    }
+    return nullptr;
+  }
+
+  char* src = reader->data + reader->used;
+  if(dst)
+  {
+    memcpy(dst, src, size);
+  }
+  reader->used += size;
+  return src;
+}
+
+int level_read_int(LevelReader* reader)
+{
+  int value;
+  level_read(reader, &value, sizeof(value));
+  return value;
+}
+
+float level_read_float(LevelReader* reader)
+{
+  float value;
+  level_read(reader, &value, sizeof(value));
+  return value;
+}
+
+IVec2 level_read_ivec2(LevelReader* reader)
+{
+  IVec2 value;
+  value.x = level_read_int(reader);
+  value.y = level_read_int(reader);
+  return value;
+}
+
+bool level_read_rle(LevelReader* reader, unsigned char* dst, int dstSize)
+{
+  int encodedSize = level_read_int(reader);
+  unsigned char* encoded = (unsigned char*)level_read(reader, nullptr, encodedSize);
+  return encoded && rle_decode(encoded, encodedSize, dst, dstSize);
+}
+
+// Sets a Bit in decodedLayers for every Tile Layer, a Level needs all of them
+bool decode_level_chunk(LevelReader* reader, LevelChunkID id, Level* level, int* decodedLayers)
+{
+  TileMap* layers[LEVEL_LAYER_COUNT] = {&level->tileMap, &level->bgTileMap};
+  switch(id)
+  {
+    case LEVEL_CHUNK_INFO:
+    {
+      level->playerStartPos = level_read_ivec2(reader);
+      IVec2 worldSize = level_read_ivec2(reader);
+      if(worldSize.x != WORLD_SIZE.x || worldSize.y != WORLD_SIZE.y)
+      {
+        SM_WARN("Level is %dx%d Tiles, the World is %dx%d",
+                worldSize.x, worldSize.y, WORLD_SIZE.x, WORLD_SIZE.y);
+        return false;
+      }
+      return true;
+    }
+
+    case LEVEL_CHUNK_TILESET:
+    {
+      int layer = level_read_int(reader);
+      int count = level_read_int(reader);
+      if(layer < 0 || layer >= LEVEL_LAYER_COUNT || count < 0 ||
+         count > layers[0]->tileset.tileCoords.maxElements)
+      {
+        return false;
+      }
+
+      Tileset* tileset = &layers[layer]->tileset;
+      tileset->tileCoords.clear();
+      for(int coordIdx = 0; coordIdx < count; coordIdx++)
+      {
+        tileset->tileCoords.add(level_read_ivec2(reader));
+      }
+      return !reader->overflow;
+    }
+
+    case LEVEL_CHUNK_TILES:
+    {
+      int layer = level_read_int(reader);
+      if(layer < 0 || layer >= LEVEL_LAYER_COUNT)
+      {
+        return false;
+      }
+
+      constexpr int TILE_COUNT = WORLD_SIZE.x * WORLD_SIZE.y;
+      unsigned char tileTypes[TILE_COUNT];
+      if(!level_read_rle(reader, tileTypes, TILE_COUNT))
+      {
+        return false;
+      }
+
+      for(int tileIdx = 0; tileIdx < TILE_COUNT; tileIdx++)
+      {
+        if(tileTypes[tileIdx] >= TILE_TYPE_COUNT)
+        {
+          return false;
+        }
+        layers[layer]->tiles[tileIdx] = {(TileType)tileTypes[tileIdx]};
+      }
+      *decodedLayers |= BIT(layer);
+      return true;
+    }
+
+    case LEVEL_CHUNK_SOLIDS:
+    {
+      int count = level_read_int(reader);
+      if(count < 0 || count > level->solids.maxElements)
+      {
+        return false;
+      }
+
+      level->solids = {};
+      for(int solidIdx = 0; solidIdx < count; solidIdx++)
+      {
+        int spriteID = level_read_int(reader);
+        if(spriteID < 0 || spriteID >= SPRITE_COUNT)
+        {
+          return false;
+        }
+
+        Solid solid = {};
+        solid.spriteID = (SpriteID)spriteID;
+        solid.pos = level_read_ivec2(reader);
+        solid.prevPos = solid.pos;
+
+        int keyframeCount = level_read_int(reader);
+        if(keyframeCount < 0 || keyframeCount > solid.keyframes.maxElements)
+        {
+          return false;
+        }
+        for(int keyframeIdx = 0; keyframeIdx < keyframeCount; keyframeIdx++)
+        {
+          Keyframe keyframe = {};
+          keyframe.pos = level_read_ivec2(reader);
+          keyframe.time = level_read_float(reader);
+          solid.keyframes.add(keyframe);
+        }
+
+        level->solids.add(solid);
+      }
+
+      // Files from before the Pool Layout end here, their Solids get new Handles
+      if(reader->used == reader->size)
+      {
+        return !reader->overflow;
+      }
+
+      constexpr int MAX_SOLIDS = decltype(Level::solids)::maxElements;
+      int slotCount = level_read_int(reader);
+      if(slotCount < count || slotCount > MAX_SOLIDS)
+      {
+        return false;
+      }
+
+      // Every Slot shows up exactly once, or the Pool would index past its Arrays
+      unsigned short denseToSlot[MAX_SOLIDS];
+      unsigned short generations[MAX_SOLIDS];
+      bool usedSlots[MAX_SOLIDS] = {};
+      for(int slotIdx = 0; slotIdx < slotCount; slotIdx++)
+      {
+        int slot = level_read_int(reader);
+        if(slot < 0 || slot >= slotCount || usedSlots[slot])
+        {
+          return false;
+        }
+        usedSlots[slot] = true;
+        denseToSlot[slotIdx] = (unsigned short)slot;
+        generations[slotIdx] = (unsigned short)level_read_int(reader);
+      }
+      return !reader->overflow && 
+             level->solids.restore_slots(slotCount, denseToSlot, generations);
+    }
+
+    default:
+    {
+      break;
+    }
+  }
+
+  // Not a Level Chunk, the Caller decides
+  return true;
+}
+
+// Calls decode_chunk for every Chunk it knows the Version of
+template <typename DecodeChunk>
+bool decode_level_file(char* data, int size, DecodeChunk decode_chunk)
+{
+  LevelReader reader = {data, size};
+  LevelFileHeader header = {};
+  level_read(&reader, &header, sizeof(header));
+  if(header.magic != LEVEL_FILE_MAGIC || header.version > LEVEL_FILE_VERSION)
+  {
+    SM_WARN("Not a Level File or newer than Version %d", LEVEL_FILE_VERSION);
+    return false;
+  }
+
+  for(int chunkIdx = 0; chunkIdx < header.chunkCount; chunkIdx++)
+  {
+    LevelChunkHeader chunkHeader = {};
+    level_read(&reader, &chunkHeader, sizeof(chunkHeader));
+    char* payload = level_read(&reader, nullptr, chunkHeader.size);
+    if(!payload)
+    {
+      SM_WARN("Level File truncated in Chunk %d", chunkIdx);
+      return false;
+    }
+
+    if(chunkHeader.version > LEVEL_CHUNK_VERSION)
+    {
+      SM_WARN("Skipping Level Chunk %.4s Version %d", (char*)&chunkHeader.id,
+              chunkHeader.version);
+      continue;
+    }
+
+    LevelReader chunkReader = {payload, chunkHeader.size};
+    if(!decode_chunk(&chunkReader, (LevelChunkID)chunkHeader.id) || chunkReader.overflow)
+    {
+      SM_WARN("Broken Level Chunk %.4s", (char*)&chunkHeader.id);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Every Tile gets written by the Tile Chunks, only the rest is cleared
+bool decode_level(char* data, int size, Level* level)
+{
+  level->playerStartPos = {};
+  level->tileMap.tileset.tileCoords.clear();
+  level->bgTileMap.tileset.tileCoords.clear();
+  level->solids = {};
+
+  int decodedLayers = 0;
+  bool decoded = decode_level_file(data, size, [&](LevelReader* reader, LevelChunkID id)
+  {
+    return decode_level_chunk(reader, id, level, &decodedLayers);
+  });
+
+  return decoded && decodedLayers == ALL_LEVEL_LAYERS;
+}
+
+bool decode_game_state(char* data, int size, GameState* state)
+{
+  bool hasGameState = false;
+  int decodedLayers = 0;
+  Level* level = &state->level;
+  bool decoded = decode_level_file(data, size, [&](LevelReader* reader, LevelChunkID id)
+  {
+    if(id != LEVEL_CHUNK_GAME_STATE)
+    {
+      return hasGameState && decode_level_chunk(reader, id, level, &decodedLayers);
+    }
+
+    if(level_read_int(reader) != sizeof(GameState))
+    {
+      SM_WARN("GameState changed since the File was saved");
+      return false;
+    }
+
+    // Written first with a zeroed Level, the Level Chunks after it fill it in
+    hasGameState = level_read_rle(reader, (unsigned char*)state, sizeof(GameState));
+    return hasGameState;
+  });
+
+  return decoded && hasGameState && decodedLayers == ALL_LEVEL_LAYERS;
+}
+
+// #############################################################################
+//                           Level Files
+// #############################################################################
+// The Level as it was dumped raw before the chunked Format
+struct RawLevelV1
+{
+  int version;
+  IVec2 playerStartPos;
+  TileMap tileMap;
+  TileMap bgTileMap;
+  Array<Solid, 50> solids;
+};
+
+// Raw Dumps from before the chunked Format get imported Field by Field
+bool load_level_file(char* path, Level* level, BumpAllocator* transientStorage)
+{
+  TempArena temp(transientStorage);
+  int fileSize = 0;
+  char* data = read_file(path, &fileSize, transientStorage, ALLOC_TAG_GAME);
+  if(!data)
+  {
+    return false;
+  }
+
+  if(fileSize == sizeof(RawLevelV1) && *(unsigned int*)data != LEVEL_FILE_MAGIC)
+  {
+    SM_TRACE("Importing raw Level: %s", path);
+    RawLevelV1* rawLevel = (RawLevelV1*)data;
+    if(rawLevel->solids.count < 0 || rawLevel->solids.count > level->solids.maxElements)
+    {
+      return false;
+    }
+
+    level->playerStartPos = rawLevel->playerStartPos;
+    level->tileMap = rawLevel->tileMap;
+    level->bgTileMap = rawLevel->bgTileMap;
+    level->solids.clear();
+    for(int solidIdx = 0; solidIdx < rawLevel->solids.count; solidIdx++)
+    {
+      level->solids.add(rawLevel->solids[solidIdx]);
+    }
+    return true;
+  }
+
+  // Decode into a Copy, a broken File leaves the Level alone
+  Level* decoded = (Level*)bump_alloc(transientStorage, sizeof(Level), ALLOC_TAG_GAME);
+  if(!decoded || !decode_level(data, fileSize, decoded))
+  {
+    return false;
+  }
+
+  *level = *decoded;
+  return true;
+}
+
+bool load_game_state_file(char* path, GameState* state, BumpAllocator* transientStorage)
+{
+  TempArena temp(transientStorage);
+  int fileSize = 0;
+  char* data = read_file(path, &fileSize, transientStorage, ALLOC_TAG_GAME);
+  if(!data)
+  {
+    return false;
+  }
+
+  if(fileSize == sizeof(GameState) && *(unsigned int*)data != LEVEL_FILE_MAGIC)
+  {
+    SM_TRACE("Importing raw GameState: %s", path);
+    memcpy(state, data, sizeof(GameState));
+    return true;
+  }
+
+  GameState* decoded = (GameState*)bump_alloc(transientStorage, sizeof(GameState), ALLOC_TAG_GAME);
+  if(!decoded || !decode_game_state(data, fileSize, decoded))
+  {
+    return false;
+  }
+
+  *state = *decoded;
+  return true;
+}
+
+// Debug Builds run this on Startup. Saved Solid Handles survive a Round Trip,
+// SOLD Chunks with Slots out of range or used twice are rejected, so are
+// Tile Types and Sprite IDs past the end of their Enums
+bool check_level_file(BumpAllocator* scratch)
+{
+  TempArena temp(scratch);
+  Level* level = (Level*)bump_alloc(scratch, sizeof(Level), ALLOC_TAG_GAME);
+  Level* decoded = (Level*)bump_alloc(scratch, sizeof(Level), ALLOC_TAG_GAME);
+  int capacity = rle_max_encoded_size(sizeof(Level)) + KB(4);
+  char* buffer = bump_alloc(scratch, capacity, ALLOC_TAG_GAME);
+  if(!level || !decoded || !buffer)
+  {
+    return false;
+  }
+
+  *level = {};
+  PoolHandle first = level->solids.add({.spriteID = SPRITE_SOLID_01});
+  PoolHandle second = level->solids.add({.spriteID = SPRITE_SOLID_02});
+  level->solids.remove(first);
+
+  int size = encode_level(level, buffer, capacity);
+  bool passed = size && decode_level(buffer, size, decoded);
+  passed &= decoded->solids.get(second) && !decoded->solids.get(first);
+
+  // One Solid in two Slots, then the Slot Layout
+  auto decode_solids = [&](int slot0, int slot1, int spriteID)
+  {
+    LevelWriter writer = {buffer, capacity};
+    level_write_int(&writer, 1);
+    level_write_int(&writer, spriteID);
+    level_write_ivec2(&writer, {});
+    level_write_int(&writer, 0);
+    level_write_int(&writer, 2);
+    level_write_int(&writer, slot0);
+    level_write_int(&writer, 1);
+    level_write_int(&writer, slot1);
+    level_write_int(&writer, 1);
+
+    LevelReader reader = {buffer, writer.used};
+    int decodedLayers = 0;
+    return decode_level_chunk(&reader, LEVEL_CHUNK_SOLIDS, decoded, &decodedLayers);
+  };
+  passed &= decode_solids(1, 0, SPRITE_SOLID_01);
+  passed &= !decode_solids(0, 0xFFFF, SPRITE_SOLID_01) && !decode_solids(0, -1, SPRITE_SOLID_01);
+  passed &= !decode_solids(1, 1, SPRITE_SOLID_01);
+
+  // Enums from the File are range checked before the Cast
+  passed &= !decode_solids(1, 0, SPRITE_COUNT) && !decode_solids(1, 0, -1);
+
+  constexpr int TILE_COUNT = WORLD_SIZE.x * WORLD_SIZE.y;
+  unsigned char tileTypes[TILE_COUNT] = {};
+  tileTypes[TILE_COUNT - 1] = TILE_TYPE_COUNT;
+  LevelWriter writer = {buffer, capacity};
+  level_write_int(&writer, LEVEL_LAYER_FOREGROUND);
+  level_write_rle(&writer, tileTypes, TILE_COUNT);
+  LevelReader reader = {buffer, writer.used};
+  int decodedLayers = 0;
+  passed &= !decode_level_chunk(&reader, LEVEL_CHUNK_TILES, decoded, &decodedLayers);
+
+  if(!passed)
+  {
+    SM_ERROR("Level File: broken Chunks are not rejected");
+  }
+  return passed;
+}
+
+// #############################################################################
+//                           Background Saves
+// #############################################################################
+// The Game Thread copies what to save into the Snapshot and queues it, the
+// Save Worker in main.cpp encodes it and writes a temporary File that gets
+// renamed over the old one, a Crash mid Save leaves the old File intact
+static constexpr int MAX_SAVE_PATH = 64;
+static constexpr float SAVE_RESULT_DISPLAY_TIME = 2.0f;
+
+enum SaveKind
+{
+  SAVE_KIND_LEVEL,
+  SAVE_KIND_GAME_STATE
+};
+
+// The Game Thread owns the SaveState while IDLE, DONE or FAILED,
+// the Worker while QUEUED or WRITING
+enum SaveStatus
+{
+  SAVE_STATUS_IDLE,
+  SAVE_STATUS_QUEUED,
+  SAVE_STATUS_WRITING,
+  SAVE_STATUS_DONE,
+  SAVE_STATUS_FAILED
+};
+
+struct SaveState
+{
+  SaveStatus status;
+  SaveKind kind;
+  char path[MAX_SAVE_PATH];
+  GameState snapshot;
+
+  // Timings, the Snapshot is all the Game Thread pays for
+  double snapshotMs;
+  double encodeMs;
+  double writeMs;
+  int fileSize;
+
+  // How long the Result stays on screen
+  float resultTimer;
+};
+
+// #############################################################################
+//                           Save Globals
+// #############################################################################
+static SaveState* saveState;
+
+// #############################################################################
+//                           Save Functions
+// #############################################################################
+SaveStatus get_save_status()
+{
+  return __atomic_load_n(&saveState->status, __ATOMIC_ACQUIRE);
+}
+
+bool save_in_flight()
+{
+  SaveStatus status = get_save_status();
+  return status == SAVE_STATUS_QUEUED || status == SAVE_STATUS_WRITING;
+}
+
+// Returns false while the previous Save is still being written
+bool queue_save(SaveKind kind, char* path, void* data, int size)
+{
+  SM_ASSERT(strlen(path) < MAX_SAVE_PATH, "Save Path too long: %s", path);
+  if(save_in_flight())
+  {
+    SM_WARN("Still writing %s, not saving %s", saveState->path, path);
+    return false;
+  }
+
+  long long startUs = get_time_us();
+  saveState->kind = kind;
+  strcpy(saveState->path, path);
+  memcpy(kind == SAVE_KIND_LEVEL? (void*)&saveState->snapshot.level : 
+                                  (void*)&saveState->snapshot, data, size);
+  saveState->snapshotMs = (get_time_us() - startUs) / 1000.0;
+  saveState->resultTimer = SAVE_RESULT_DISPLAY_TIME;
+
+  __atomic_store_n(&saveState->status, SAVE_STATUS_QUEUED, __ATOMIC_RELEASE);
+  return true;
+}
+
+bool queue_level_save(char* path, Level* level)
+{
+  return queue_save(SAVE_KIND_LEVEL, path, level, sizeof(Level));
+}
+
+bool queue_game_state_save(char* path, GameState* state)
+{
+  return queue_save(SAVE_KIND_GAME_STATE, path, state, sizeof(GameState));
+}
+
+// Called by the Save Worker, returns the encoded Size, 0 on failure
+int encode_save(SaveState* save, char* buffer, int capacity, BumpAllocator* scratch)
+{
+  if(save->kind == SAVE_KIND_LEVEL)
+  {
+    return encode_level(&save->snapshot.level, buffer, capacity);
+  }
+
+  return encode_game_state(&save->snapshot, buffer, capacity, scratch);
+}
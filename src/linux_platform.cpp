@@ -6,12 +6,163 @@
 #include <GL/glx.h>
 #include <dlfcn.h>  // for loading the so (DLL) file
 #include <unistd.h> // for sleep
+#include <pthread.h> // for the audio mixer thread
+#include <time.h>    // for clock_gettime
+#include <semaphore.h> // to wake the streaming I/O thread
+#include <errno.h>     // for EPIPE, ALSA underruns
+#include <fcntl.h>        // for open, staging the game.so
+#include <sys/sendfile.h> // for sendfile, copy_file_range fallback
+
+#ifdef __SSE2__
+#include <immintrin.h> // SSE2 / AVX2 mixing
+#endif
 
 // #############################################################################
 //                           Linux Defines
 // #############################################################################
 static constexpr int BUTTONS_KEYCODE_OFFSET = 250;
 
+// Defaults, SM_AUDIO_PERIOD_FRAMES and SM_AUDIO_BUFFER_PERIODS override them.
+// 512 Frames are ~11.6ms at 44100 Hz, the Device buffers 4 Periods
+static constexpr int AUDIO_PERIOD_FRAMES = 512;
+static constexpr int AUDIO_BUFFER_PERIODS = 4;
+static constexpr int MIN_AUDIO_PERIOD_FRAMES = 64;
+static constexpr int MAX_AUDIO_PERIOD_FRAMES = 4096;
+
+// Per Stage, the last ones are kept for percentiles
+static constexpr int AUDIO_LATENCY_SAMPLES = 1024;
+
+// Voices tracked by the Mixer, only MAX_CONCURRENT_SOUNDS of them are mixed
+static constexpr int MAX_VIRTUAL_VOICES = 128;
+
+// Two Chunks per Stream, 128 KB are ~0.75s at 44100 Hz Stereo
+static constexpr int MAX_AUDIO_STREAMS = 4;
+static constexpr int STREAM_CHUNK_SIZE = KB(128);
+
+// #############################################################################
+//                           Linux Structs
+// #############################################################################
+// Where the mixer writes its output to. write() either blocks on the
+// device clock (realtime) or returns immediately, in which case the
+// mixer paces itself, unless told to run unpaced for benchmarking
+struct AudioSink
+{
+  char* name;
+  bool realtime;
+  void* userData;
+
+  bool (*write)(AudioSink* sink, short* samples, int frameCount);
+
+  // Frames written but not played yet, nullptr if the Sink can't tell
+  int (*queued_frames)(AudioSink* sink);
+};
+
+// play_sound() -> Mixer picks up the Command -> Period containing the first
+// Sample is written to the Sink -> first Sample leaves the Device
+enum AudioLatencyStage
+{
+  AUDIO_LATENCY_QUEUE,
+  AUDIO_LATENCY_MIX,
+  AUDIO_LATENCY_DEVICE,
+  AUDIO_LATENCY_TOTAL,
+  AUDIO_LATENCY_STAGE_COUNT
+};
+
+// Ring Buffer in Microseconds
+struct AudioLatencySamples
+{
+  int count;
+  int samples[AUDIO_LATENCY_SAMPLES];
+};
+
+enum AudioStreamState
+{
+  AUDIO_STREAM_FREE,
+  AUDIO_STREAM_OPEN_REQUESTED,  // Mixer -> I/O Thread
+  AUDIO_STREAM_STREAMING,
+  AUDIO_STREAM_CLOSE_REQUESTED, // Mixer -> I/O Thread, which sets FREE
+};
+
+// The I/O Thread fills a Chunk and marks it full, the Mixer drains
+// it and marks it empty, so each Chunk has exactly one owner at a time
+struct AudioStream
+{
+  int state; // AudioStreamState, atomic
+  SoundHandle sound;
+
+  // I/O Thread only
+  FILE* file;
+  int bytesRead;
+  int nextChunk;
+
+  // Mixer only
+  int readChunk;
+  int readCursor; // In Bytes
+
+  int chunkFull[2]; // atomic
+  int chunkSizes[2];
+  char chunks[2][STREAM_CHUNK_SIZE];
+};
+
+struct MixerVoice
+{
+  bool playing;
+  SoundHandle sound;
+  AudioStream* stream; // nullptr for Sounds in memory
+  short* samples;
+  int frameCount;
+  int cursor; // In Frames
+
+  float volume;
+  float fadeGain;
+  float fadeStep; // Per Frame, > 0 fades in, < 0 fades out
+
+  int priority;
+  bool audible; // Mixed last Period, virtual Voices only advance their cursor
+
+  long long enqueueUs;
+  long long pickupUs;
+  bool latencyRecorded;
+};
+
+struct LinuxAudio
+{
+  pthread_t thread;
+  AudioSink sink;
+  bool unpaced;
+  int periodFrames;
+  int bufferFrames;
+
+  // Streaming, the Mixer posts ioSemaphore whenever it needs data
+  pthread_t ioThread;
+  sem_t ioSemaphore;
+  AudioStream streams[MAX_AUDIO_STREAMS];
+  int streamUnderruns;
+
+  // Only touched by the mixer thread
+  MixerVoice voices[MAX_VIRTUAL_VOICES];
+  int audibleVoices[MAX_CONCURRENT_SOUNDS];
+  int audibleVoiceCount;
+
+  // Bitmask of Voices per SoundHandle - 1
+  unsigned long long soundVoices[MAX_ALLOCATED_SOUNDS][MAX_VIRTUAL_VOICES / 64];
+  float accumulator[MAX_AUDIO_PERIOD_FRAMES * NUM_CHANNELS];
+  short output[MAX_AUDIO_PERIOD_FRAMES * NUM_CHANNELS];
+
+  // Stats
+  long long framesMixed;
+  double secondsMixing;
+  int peakVoices;
+
+  // Latency, Voices heard for the first time this Period
+  // are recorded once the Period is written
+  int newVoiceCount;
+  long long newVoiceEnqueueUs[MAX_CONCURRENT_SOUNDS];
+  long long newVoicePickupUs[MAX_CONCURRENT_SOUNDS];
+  AudioLatencySamples latency[AUDIO_LATENCY_STAGE_COUNT];
+  int underruns; // The Device ran dry
+};
+
 // #############################################################################
 //                           Linux Globals
 // #############################################################################
@@ -20,6 +171,7 @@ static PFNGLXSWAPINTERVALEXTPROC glXSwapIntervalEXT_ptr;
 static Display* display;
 static Atom wmDeleteWindow;
 static Window window;
+static LinuxAudio linuxAudio;
 
 // #############################################################################
 //                           Platform Implementations
@@ -220,7 +372,131 @@ bool platform_free_dynamic_library(void* dll)
   int freeResult = dlclose(dll);
   SM_ASSERT(!freeResult, "Failed to dlclose");
 
-  return (bool)freeResult;
+  return !freeResult;
+}
+
+// Copies inside the Kernel, no Buffer in user space. copy_file_range()
+// can even share Extents on CoW Filesystems, sendfile() is the fallback
+// for Kernels and Filesystems that don't support it
+bool platform_copy_file(const char* fileName, const char* outputName)
+{
+  int input = open(fileName, O_RDONLY);
+  if(input < 0)
+  {
+    return false;
+  }
+
+  struct stat inputStat = {};
+  if(fstat(input, &inputStat) != 0 || !inputStat.st_size)
+  {
+    close(input);
+    return false;
+  }
+
+  int output = open(outputName, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+  if(output < 0)
+  {
+    SM_ERROR("Failed opening File: %s", outputName);
+    close(input);
+    return false;
+  }
+
+  off_t remaining = inputStat.st_size;
+  bool useSendfile = false;
+  while(remaining > 0)
+  {
+    ssize_t copied = useSendfile? sendfile(output, input, nullptr, remaining) :
+                                  copy_file_range(input, nullptr, output, nullptr, remaining, 0);
+    if(copied < 0 && !useSendfile && 
+       (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP))
+    {
+      useSendfile = true;
+      continue;
+    }
+
+    // 0 means the File got shorter, the Build is still writing it
+    if(copied <= 0)
+    {
+      break;
+    }
+    remaining -= copied;
+  }
+
+  close(input);
+  close(output);
+  return remaining == 0;
+}
+
+// Writes fileName.tmp, syncs it and renames it over fileName,
+// Readers see the old or the new File, never half of one
+bool platform_write_file_atomic(const char* fileName, char* buffer, int size)
+{
+  char tmpName[256];
+  snprintf(tmpName, sizeof(tmpName), "%s.tmp", fileName);
+
+  int file = open(tmpName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(file < 0)
+  {
+    return false;
+  }
+
+  int written = 0;
+  while(written < size)
+  {
+    ssize_t result = write(file, buffer + written, size - written);
+    if(result < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if(result <= 0)
+    {
+      break;
+    }
+    written += result;
+  }
+
+  // The Data has to hit the Disk before the rename does
+  bool synced = written == size && fsync(file) == 0;
+  close(file);
+  if(!synced || rename(tmpName, fileName) != 0)
+  {
+    unlink(tmpName);
+    return false;
+  }
+
+  return true;
+}
+
+struct LinuxThreadStart
+{
+  PlatformThreadProc threadProc;
+  void* data;
+};
+
+void* linux_thread_start(void* arg)
+{
+  LinuxThreadStart start = *(LinuxThreadStart*)arg;
+  free(arg);
+  start.threadProc(start.data);
+  return nullptr;
+}
+
+// Detached, runs until the Process exits
+bool platform_create_thread(PlatformThreadProc threadProc, void* data)
+{
+  LinuxThreadStart* start = (LinuxThreadStart*)malloc(sizeof(LinuxThreadStart));
+  *start = {threadProc, data};
+
+  pthread_t thread;
+  if(pthread_create(&thread, nullptr, linux_thread_start, start) != 0)
+  {
+    free(start);
+    return false;
+  }
+  pthread_detach(thread);
+
+  return true;
 }
 
 void platform_fill_keycode_lookup_table()
@@ -359,19 +635,892 @@ void platform_fill_keycode_lookup_table()
   KeyCodeLookupTable[XKeysymToKeycode(display, XK_KP_9)] = KEY_NUMPAD_9;
 }
 
+// #############################################################################
+//                           Linux Audio Sinks
+// #############################################################################
+// ALSA is loaded at runtime, that way we neither need the
+// headers to build, nor libasound to run headless
+typedef struct _snd_pcm snd_pcm_t;
+static constexpr int SND_PCM_STREAM_PLAYBACK = 0;
+static constexpr int SND_PCM_FORMAT_S16_LE = 2;
+static constexpr int SND_PCM_ACCESS_RW_INTERLEAVED = 3;
+
+typedef int snd_pcm_open_type(snd_pcm_t** pcm, const char* name, int stream, int mode);
+typedef int snd_pcm_set_params_type(snd_pcm_t* pcm, int format, int access,
+                                    unsigned int channels, unsigned int rate,
+                                    int softResample, unsigned int latency);
+typedef long snd_pcm_writei_type(snd_pcm_t* pcm, const void* buffer, unsigned long frames);
+typedef int snd_pcm_recover_type(snd_pcm_t* pcm, int err, int silent);
+typedef int snd_pcm_delay_type(snd_pcm_t* pcm, long* delay);
+
+static snd_pcm_writei_type* snd_pcm_writei_ptr;
+static snd_pcm_recover_type* snd_pcm_recover_ptr;
+static snd_pcm_delay_type* snd_pcm_delay_ptr;
+
+bool alsa_sink_write(AudioSink* sink, short* samples, int frameCount)
+{
+  snd_pcm_t* pcm = (snd_pcm_t*)sink->userData;
+  while(frameCount > 0)
+  {
+    long written = snd_pcm_writei_ptr(pcm, samples, frameCount);
+    if(written < 0)
+    {
+      if(written == -EPIPE)
+      {
+        linuxAudio.underruns++;
+      }
+
+      // Underrun or Suspend, try to recover
+      if(snd_pcm_recover_ptr(pcm, (int)written, 1) < 0)
+      {
+        SM_ERROR("ALSA: Failed to write %d Frames", frameCount);
+        return false;
+      }
+      continue;
+    }
+
+    samples += written * NUM_CHANNELS;
+    frameCount -= written;
+  }
+
+  return true;
+}
+
+int alsa_sink_queued_frames(AudioSink* sink)
+{
+  long delay = 0;
+  if(snd_pcm_delay_ptr((snd_pcm_t*)sink->userData, &delay) < 0)
+  {
+    return 0;
+  }
+
+  return (int)delay;
+}
+
+bool make_alsa_sink(AudioSink* sink, int bufferFrames)
+{
+  void* alsaLib = dlopen("libasound.so.2", RTLD_NOW);
+  if(!alsaLib)
+  {
+    SM_WARN("ALSA: libasound.so.2 not found");
+    return false;
+  }
+
+  snd_pcm_open_type* snd_pcm_open_ptr = 
+    (snd_pcm_open_type*)dlsym(alsaLib, "snd_pcm_open");
+  snd_pcm_set_params_type* snd_pcm_set_params_ptr = 
+    (snd_pcm_set_params_type*)dlsym(alsaLib, "snd_pcm_set_params");
+  snd_pcm_writei_ptr = (snd_pcm_writei_type*)dlsym(alsaLib, "snd_pcm_writei");
+  snd_pcm_recover_ptr = (snd_pcm_recover_type*)dlsym(alsaLib, "snd_pcm_recover");
+  snd_pcm_delay_ptr = (snd_pcm_delay_type*)dlsym(alsaLib, "snd_pcm_delay");
+  if(!snd_pcm_open_ptr || !snd_pcm_set_params_ptr || 
+     !snd_pcm_writei_ptr || !snd_pcm_recover_ptr || !snd_pcm_delay_ptr)
+  {
+    SM_WARN("ALSA: Failed to load functions from libasound.so.2");
+    return false;
+  }
+
+  snd_pcm_t* pcm = nullptr;
+  if(snd_pcm_open_ptr(&pcm, "default", SND_PCM_STREAM_PLAYBACK, 0) < 0)
+  {
+    SM_WARN("ALSA: Failed to open default Device");
+    return false;
+  }
+
+  if(snd_pcm_set_params_ptr(pcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED,
+                            NUM_CHANNELS, SAMPLE_RATE, 1, 
+                            (unsigned int)((long long)bufferFrames * 1000000 / SAMPLE_RATE)) < 0)
+  {
+    SM_WARN("ALSA: Failed to set 16 Bit, %d Channels, %d Hz", NUM_CHANNELS, SAMPLE_RATE);
+    return false;
+  }
+
+  sink->name = "alsa";
+  sink->realtime = true;
+  sink->userData = pcm;
+  sink->write = alsa_sink_write;
+  sink->queued_frames = alsa_sink_queued_frames;
+
+  return true;
+}
+
+struct WAVSinkData
+{
+  FILE* file;
+  WAVHeader header;
+};
+
+bool wav_sink_write(AudioSink* sink, short* samples, int frameCount)
+{
+  WAVSinkData* wavSink = (WAVSinkData*)sink->userData;
+  int size = frameCount * NUM_CHANNELS * sizeof(short);
+  if(fwrite(samples, 1, size, wavSink->file) != (size_t)size)
+  {
+    SM_ERROR("WAV Sink: Failed to write %d Bytes", size);
+    return false;
+  }
+
+  // Patch the Chunk sizes every write, the file stays valid
+  // even if the process gets killed
+  wavSink->header.dataChunkSize += size;
+  wavSink->header.riffChunkSize = sizeof(WAVHeader) - 8 + wavSink->header.dataChunkSize;
+  long end = ftell(wavSink->file);
+  fseek(wavSink->file, 0, SEEK_SET);
+  fwrite(&wavSink->header, sizeof(WAVHeader), 1, wavSink->file);
+  fseek(wavSink->file, end, SEEK_SET);
+
+  return true;
+}
+
+bool make_wav_sink(AudioSink* sink, const char* path)
+{
+  static WAVSinkData wavSink;
+  wavSink.file = fopen(path, "wb");
+  if(!wavSink.file)
+  {
+    SM_ERROR("WAV Sink: Failed opening File: %s", path);
+    return false;
+  }
+
+  WAVHeader* header = &wavSink.header;
+  memcpy(&header->riffChunkId, "RIFF", 4);
+  memcpy(&header->format, "WAVE", 4);
+  memcpy(&header->formatChunkId, "fmt ", 4);
+  memcpy(header->dataChunkId, "data", 4);
+  header->formatChunkSize = 16;
+  header->audioFormat = 1; // PCM
+  header->numChannels = NUM_CHANNELS;
+  header->sampleRate = SAMPLE_RATE;
+  header->bitsPerSample = 16;
+  header->blockAlign = NUM_CHANNELS * sizeof(short);
+  header->byteRate = SAMPLE_RATE * header->blockAlign;
+  header->riffChunkSize = sizeof(WAVHeader) - 8;
+  fwrite(header, sizeof(WAVHeader), 1, wavSink.file);
+
+  sink->name = "wav";
+  sink->realtime = false;
+  sink->userData = &wavSink;
+  sink->write = wav_sink_write;
+  sink->queued_frames = nullptr;
+
+  return true;
+}
+
+bool null_sink_write(AudioSink* sink, short* samples, int frameCount)
+{
+  return true;
+}
+
+void make_null_sink(AudioSink* sink)
+{
+  sink->name = "null";
+  sink->realtime = false;
+  sink->userData = nullptr;
+  sink->write = null_sink_write;
+  sink->queued_frames = nullptr;
+}
+
+// #############################################################################
+//                           Linux Audio Streaming
+// #############################################################################
+AudioStream* mixer_open_stream(SoundHandle sound)
+{
+  for(int streamIdx = 0; streamIdx < MAX_AUDIO_STREAMS; streamIdx++)
+  {
+    AudioStream* stream = &linuxAudio.streams[streamIdx];
+    if(__atomic_load_n(&stream->state, __ATOMIC_ACQUIRE) == AUDIO_STREAM_FREE)
+    {
+      stream->sound = sound;
+      stream->readChunk = 0;
+      stream->readCursor = 0;
+      stream->chunkFull[0] = false;
+      stream->chunkFull[1] = false;
+      __atomic_store_n(&stream->state, AUDIO_STREAM_OPEN_REQUESTED, __ATOMIC_RELEASE);
+      sem_post(&linuxAudio.ioSemaphore);
+      return stream;
+    }
+  }
+
+  return nullptr;
+}
+
+void mixer_close_stream(AudioStream* stream)
+{
+  __atomic_store_n(&stream->state, AUDIO_STREAM_CLOSE_REQUESTED, __ATOMIC_RELEASE);
+  sem_post(&linuxAudio.ioSemaphore);
+}
+
+// Reads the next part of the data Chunk into the next empty buffer
+void io_fill_stream(AudioStream* stream)
+{
+  int chunkIdx = stream->nextChunk;
+  if(__atomic_load_n(&stream->chunkFull[chunkIdx], __ATOMIC_ACQUIRE))
+  {
+    return;
+  }
+
+  Sound* sound = get_sound(stream->sound);
+  int size = min(STREAM_CHUNK_SIZE, sound->size - stream->bytesRead);
+  if(size <= 0)
+  {
+    return;
+  }
+
+  int bytesRead = (int)fread(stream->chunks[chunkIdx], 1, size, stream->file);
+  if(bytesRead != size)
+  {
+    // Truncated File, play silence for the rest
+    SM_ERROR("Streaming: Failed reading %s", sound->path);
+    memset(stream->chunks[chunkIdx] + bytesRead, 0, size - bytesRead);
+  }
+
+  stream->bytesRead += size;
+  stream->chunkSizes[chunkIdx] = size;
+  stream->nextChunk ^= 1;
+  __atomic_store_n(&stream->chunkFull[chunkIdx], true, __ATOMIC_RELEASE);
+}
+
+void* io_thread_proc(void* param)
+{
+  while(true)
+  {
+    sem_wait(&linuxAudio.ioSemaphore);
+
+    for(int streamIdx = 0; streamIdx < MAX_AUDIO_STREAMS; streamIdx++)
+    {
+      AudioStream* stream = &linuxAudio.streams[streamIdx];
+      int state = __atomic_load_n(&stream->state, __ATOMIC_ACQUIRE);
+
+      if(state == AUDIO_STREAM_OPEN_REQUESTED)
+      {
+        Sound* sound = get_sound(stream->sound);
+        stream->file = fopen(sound->path, "rb");
+        stream->bytesRead = 0;
+        stream->nextChunk = 0;
+        if(stream->file)
+        {
+          fseek(stream->file, sound->dataOffset, SEEK_SET);
+        }
+        else
+        {
+          SM_ERROR("Streaming: Failed opening File: %s", sound->path);
+        }
+
+        // The Mixer might have closed it in the meantime
+        if(__atomic_compare_exchange_n(&stream->state, &state, AUDIO_STREAM_STREAMING, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+          state = AUDIO_STREAM_STREAMING;
+        }
+      }
+
+      if(state == AUDIO_STREAM_STREAMING && stream->file)
+      {
+        // Fill both Chunks if possible
+        io_fill_stream(stream);
+        io_fill_stream(stream);
+      }
+
+      if(state == AUDIO_STREAM_CLOSE_REQUESTED)
+      {
+        if(stream->file)
+        {
+          fclose(stream->file);
+          stream->file = nullptr;
+        }
+        __atomic_store_n(&stream->state, AUDIO_STREAM_FREE, __ATOMIC_RELEASE);
+      }
+    }
+  }
+
+  return nullptr;
+}
+
+// #############################################################################
+//                           Linux Audio Mixer
+// #############################################################################
+void mixer_start_voice(AudioCommand command, long long pickupUs)
+{
+  Sound* sound = get_sound(command.sound);
+  SM_ASSERT(sound->size > 0, "Sound has no Samples Size: %d", sound->size);
+  SM_ASSERT(sound->data || sound->streaming, "Sound has no Data!");
+
+  AudioStream* stream = nullptr;
+  if(sound->streaming)
+  {
+    stream = mixer_open_stream(command.sound);
+    if(!stream)
+    {
+      SM_WARN("Mixer: All %d Streams in use, dropping %s", MAX_AUDIO_STREAMS, sound->path);
+      push_audio_event({AUDIO_EVENT_VOICE_FINISHED, command.sound});
+      return;
+    }
+  }
+
+  for(int voiceIdx = 0; voiceIdx < MAX_VIRTUAL_VOICES; voiceIdx++)
+  {
+    MixerVoice* voice = &linuxAudio.voices[voiceIdx];
+    if(!voice->playing)
+    {
+      *voice = {};
+      voice->playing = true;
+      voice->stream = stream;
+      voice->sound = command.sound;
+      linuxAudio.soundVoices[command.sound - 1][voiceIdx / 64] |= 1ull << (voiceIdx % 64);
+      voice->samples = (short*)sound->data;
+      voice->frameCount = sound->size / (NUM_CHANNELS * sizeof(short));
+      voice->volume = command.volume;
+      voice->priority = command.priority;
+      voice->enqueueUs = command.enqueueUs;
+      voice->pickupUs = pickupUs;
+      voice->fadeGain = 1.0f;
+      if(command.options & SOUND_OPTION_FADE_IN)
+      {
+        voice->fadeGain = 0.0f;
+        voice->fadeStep = 1.0f / (FADE_DURATION * SAMPLE_RATE);
+      }
+      return;
+    }
+  }
+
+  if(stream)
+  {
+    mixer_close_stream(stream);
+  }
+
+  // The Game still counts this Voice as playing
+  push_audio_event({AUDIO_EVENT_VOICE_FINISHED, command.sound});
+}
+
+void mixer_stop_voice(MixerVoice* voice)
+{
+  if(voice->stream)
+  {
+    mixer_close_stream(voice->stream);
+    voice->stream = nullptr;
+  }
+
+  int voiceIdx = (int)(voice - linuxAudio.voices);
+  linuxAudio.soundVoices[voice->sound - 1][voiceIdx / 64] &= ~(1ull << (voiceIdx % 64));
+  voice->playing = false;
+  push_audio_event({AUDIO_EVENT_VOICE_FINISHED, voice->sound});
+}
+
+void mixer_execute_command(AudioCommand command, long long pickupUs)
+{
+  if(command.type == AUDIO_COMMAND_PLAY)
+  {
+    mixer_start_voice(command, pickupUs);
+    return;
+  }
+
+  static_assert(MAX_VIRTUAL_VOICES % 64 == 0, "soundVoices are 64 Bit masks");
+  for(int maskIdx = 0; maskIdx < MAX_VIRTUAL_VOICES / 64; maskIdx++)
+  {
+    unsigned long long voiceMask = linuxAudio.soundVoices[command.sound - 1][maskIdx];
+    while(voiceMask)
+    {
+      int voiceIdx = maskIdx * 64 + __builtin_ctzll(voiceMask);
+      voiceMask &= voiceMask - 1;
+      MixerVoice* voice = &linuxAudio.voices[voiceIdx];
+
+      switch(command.type)
+      {
+        case AUDIO_COMMAND_STOP:
+        {
+          mixer_stop_voice(voice);
+          break;
+        }
+
+        case AUDIO_COMMAND_FADE_OUT:
+        {
+          voice->fadeStep = -1.0f / (FADE_DURATION * SAMPLE_RATE);
+          break;
+        }
+
+        case AUDIO_COMMAND_SET_VOLUME:
+        {
+          voice->volume = command.volume;
+          break;
+        }
+
+        // Plays start a new Voice in mixer_start_voice()
+        default:
+        {
+          break;
+        }
+      }
+    }
+  }
+}
+
+// Adds the samples on top of the accumulator, samples are kept in
+// the int16 range, the gain ramps linearly per Frame for fades
+void mixer_mix_samples(MixerVoice* voice, short* src, float* accumulator, int frames)
+{
+  static_assert(NUM_CHANNELS == 2, "Mixer expects interleaved Stereo");
+
+  float volume = voice->volume * musicVolume;
+  float fadeGain = voice->fadeGain;
+  float fadeStep = voice->fadeStep;
+
+  int frameIdx = 0;
+#if defined(__AVX2__)
+  // 8 Frames (16 Samples) per iteration
+  {
+    __m256 volumeVec = _mm256_set1_ps(volume);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 stepLo = _mm256_mul_ps(_mm256_set1_ps(fadeStep), 
+                                  _mm256_setr_ps(0, 0, 1, 1, 2, 2, 3, 3));
+    __m256 stepHi = _mm256_mul_ps(_mm256_set1_ps(fadeStep), 
+                                  _mm256_setr_ps(4, 4, 5, 5, 6, 6, 7, 7));
+    for(; frameIdx + 8 <= frames; frameIdx += 8)
+    {
+      __m256 base = _mm256_set1_ps(fadeGain);
+      __m256 gainLo = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_add_ps(base, stepLo), zero), one), volumeVec);
+      __m256 gainHi = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_add_ps(base, stepHi), zero), one), volumeVec);
+
+      __m256i pcm = _mm256_loadu_si256((__m256i*)(src + frameIdx * NUM_CHANNELS));
+      __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(pcm)));
+      __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(pcm, 1)));
+
+      float* dst = accumulator + frameIdx * NUM_CHANNELS;
+      _mm256_storeu_ps(dst, _mm256_add_ps(_mm256_loadu_ps(dst), _mm256_mul_ps(lo, gainLo)));
+      _mm256_storeu_ps(dst + 8, _mm256_add_ps(_mm256_loadu_ps(dst + 8), _mm256_mul_ps(hi, gainHi)));
+
+      fadeGain = clamp(fadeGain + 8.0f * fadeStep, 0.0f, 1.0f);
+    }
+  }
+#elif defined(__SSE2__)
+  // 4 Frames (8 Samples) per iteration
+  {
+    __m128 volumeVec = _mm_set1_ps(volume);
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 stepLo = _mm_mul_ps(_mm_set1_ps(fadeStep), _mm_setr_ps(0, 0, 1, 1));
+    __m128 stepHi = _mm_mul_ps(_mm_set1_ps(fadeStep), _mm_setr_ps(2, 2, 3, 3));
+    for(; frameIdx + 4 <= frames; frameIdx += 4)
+    {
+      __m128 base = _mm_set1_ps(fadeGain);
+      __m128 gainLo = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_add_ps(base, stepLo), zero), one), volumeVec);
+      __m128 gainHi = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_add_ps(base, stepHi), zero), one), volumeVec);
+
+      // Sign extend int16 -> int32, SSE2 has no cvtepi16
+      __m128i pcm = _mm_loadu_si128((__m128i*)(src + frameIdx * NUM_CHANNELS));
+      __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(pcm, pcm), 16));
+      __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(pcm, pcm), 16));
+
+      float* dst = accumulator + frameIdx * NUM_CHANNELS;
+      _mm_storeu_ps(dst, _mm_add_ps(_mm_loadu_ps(dst), _mm_mul_ps(lo, gainLo)));
+      _mm_storeu_ps(dst + 4, _mm_add_ps(_mm_loadu_ps(dst + 4), _mm_mul_ps(hi, gainHi)));
+
+      fadeGain = clamp(fadeGain + 4.0f * fadeStep, 0.0f, 1.0f);
+    }
+  }
+#endif
+
+  // Remaining Frames, or everything without SIMD
+  for(; frameIdx < frames; frameIdx++)
+  {
+    float gain = fadeGain * volume;
+    accumulator[frameIdx * 2 + 0] += (float)src[frameIdx * 2 + 0] * gain;
+    accumulator[frameIdx * 2 + 1] += (float)src[frameIdx * 2 + 1] * gain;
+    fadeGain = clamp(fadeGain + fadeStep, 0.0f, 1.0f);
+  }
+
+  voice->fadeGain = fadeGain;
+  if(fadeStep > 0.0f && fadeGain == 1.0f)
+  {
+    voice->fadeStep = 0.0f;
+  }
+}
+
+// Virtual Voices keep fading without being mixed
+void mixer_advance_fade(MixerVoice* voice, int frames)
+{
+  voice->fadeGain = clamp(voice->fadeGain + voice->fadeStep * frames, 0.0f, 1.0f);
+  if(voice->fadeStep > 0.0f && voice->fadeGain == 1.0f)
+  {
+    voice->fadeStep = 0.0f;
+  }
+}
+
+// Streamed Voices only mix what the I/O Thread already delivered, if
+// a Chunk isn't there in time the Voice stalls and we count an underrun.
+// Virtual Voices pass no accumulator and just consume the Chunks
+int mixer_mix_stream(MixerVoice* voice, float* accumulator, int frameCount)
+{
+  AudioStream* stream = voice->stream;
+  int bytesPerFrame = NUM_CHANNELS * sizeof(short);
+  int framesMixed = 0;
+  while(framesMixed < frameCount)
+  {
+    int chunkIdx = stream->readChunk;
+    if(!__atomic_load_n(&stream->chunkFull[chunkIdx], __ATOMIC_ACQUIRE))
+    {
+      linuxAudio.streamUnderruns++;
+      sem_post(&linuxAudio.ioSemaphore);
+      break;
+    }
+
+    int chunkFrames = (stream->chunkSizes[chunkIdx] - stream->readCursor) / bytesPerFrame;
+    int frames = min(frameCount - framesMixed, chunkFrames);
+    short* src = (short*)(stream->chunks[chunkIdx] + stream->readCursor);
+    if(accumulator)
+    {
+      mixer_mix_samples(voice, src, accumulator + framesMixed * NUM_CHANNELS, frames);
+    }
+    else
+    {
+      mixer_advance_fade(voice, frames);
+    }
+
+    framesMixed += frames;
+    stream->readCursor += frames * bytesPerFrame;
+    if(stream->readCursor >= stream->chunkSizes[chunkIdx])
+    {
+      // Hand the Chunk back to the I/O Thread
+      stream->readCursor = 0;
+      stream->readChunk ^= 1;
+      __atomic_store_n(&stream->chunkFull[chunkIdx], false, __ATOMIC_RELEASE);
+      sem_post(&linuxAudio.ioSemaphore);
+    }
+  }
+
+  return framesMixed;
+}
+
+// Without an accumulator the Voice is virtual, it only advances
+void mixer_mix_voice(MixerVoice* voice, float* accumulator, int frameCount)
+{
+  int frames = min(frameCount, voice->frameCount - voice->cursor);
+  if(voice->stream)
+  {
+    frames = mixer_mix_stream(voice, accumulator, frames);
+  }
+  else if(!accumulator)
+  {
+    mixer_advance_fade(voice, frames);
+  }
+  else
+  {
+    mixer_mix_samples(voice, voice->samples + voice->cursor * NUM_CHANNELS, 
+                      accumulator, frames);
+  }
+
+  voice->cursor += frames;
+  if(voice->cursor >= voice->frameCount ||
+     (voice->fadeStep < 0.0f && voice->fadeGain == 0.0f))
+  {
+    mixer_stop_voice(voice);
+  }
+}
+
+// Higher Priority first, then the louder Voice. Voices that were
+// audible get a small bonus so two similar ones don't flip every Period
+float mixer_voice_score(MixerVoice* voice)
+{
+  float audibility = voice->volume * voice->fadeGain;
+  return (float)voice->priority * 4.0f + audibility + (voice->audible? 0.05f : 0.0f);
+}
+
+// Marks the MAX_CONCURRENT_SOUNDS best scoring Voices audible, insertion
+// into a short sorted list is cheap enough for MAX_VIRTUAL_VOICES
+void mixer_select_audible_voices()
+{
+  float scores[MAX_CONCURRENT_SOUNDS];
+  int count = 0;
+  int playingVoices = 0;
+  for(int voiceIdx = 0; voiceIdx < MAX_VIRTUAL_VOICES; voiceIdx++)
+  {
+    MixerVoice* voice = &linuxAudio.voices[voiceIdx];
+    if(!voice->playing)
+    {
+      continue;
+    }
+    playingVoices++;
+
+    float score = mixer_voice_score(voice);
+    int insertIdx = count;
+    while(insertIdx > 0 && scores[insertIdx - 1] < score)
+    {
+      insertIdx--;
+    }
+
+    if(insertIdx < MAX_CONCURRENT_SOUNDS)
+    {
+      int last = min(count, MAX_CONCURRENT_SOUNDS - 1);
+      for(int idx = last; idx > insertIdx; idx--)
+      {
+        scores[idx] = scores[idx - 1];
+        linuxAudio.audibleVoices[idx] = linuxAudio.audibleVoices[idx - 1];
+      }
+      scores[insertIdx] = score;
+      linuxAudio.audibleVoices[insertIdx] = voiceIdx;
+      count = min(count + 1, MAX_CONCURRENT_SOUNDS);
+    }
+  }
+
+  linuxAudio.audibleVoiceCount = count;
+  linuxAudio.peakVoices = max(linuxAudio.peakVoices, playingVoices);
+
+  for(int voiceIdx = 0; voiceIdx < MAX_VIRTUAL_VOICES; voiceIdx++)
+  {
+    linuxAudio.voices[voiceIdx].audible = false;
+  }
+  for(int idx = 0; idx < count; idx++)
+  {
+    linuxAudio.voices[linuxAudio.audibleVoices[idx]].audible = true;
+  }
+}
+
+// Converts the accumulator to int16, saturating instead of wrapping
+void mixer_clip_to_int16(float* accumulator, short* output, int sampleCount)
+{
+  int sampleIdx = 0;
+#ifdef __SSE2__
+  for(; sampleIdx + 8 <= sampleCount; sampleIdx += 8)
+  {
+    __m128i lo = _mm_cvtps_epi32(_mm_loadu_ps(accumulator + sampleIdx));
+    __m128i hi = _mm_cvtps_epi32(_mm_loadu_ps(accumulator + sampleIdx + 4));
+    _mm_storeu_si128((__m128i*)(output + sampleIdx), _mm_packs_epi32(lo, hi));
+  }
+#endif
+
+  for(; sampleIdx < sampleCount; sampleIdx++)
+  {
+    output[sampleIdx] = (short)lrintf(clamp(accumulator[sampleIdx], -32768.0f, 32767.0f));
+  }
+}
+
+double linux_get_seconds()
+{
+  timespec now = {};
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + (double)now.tv_nsec / 1000000000.0;
+}
+
+void record_audio_latency(AudioLatencyStage stage, long long us)
+{
+  AudioLatencySamples* latency = &linuxAudio.latency[stage];
+  latency->samples[latency->count % AUDIO_LATENCY_SAMPLES] = us > 0? (int)us : 0;
+  latency->count++;
+}
+
+int compare_ints(const void* a, const void* b)
+{
+  return *(int*)a - *(int*)b;
+}
+
+void report_audio_latency()
+{
+  static char* stageNames[AUDIO_LATENCY_STAGE_COUNT] = {"Queue", "Mix", "Device", "Total"};
+
+  int count = min(linuxAudio.latency[AUDIO_LATENCY_TOTAL].count, AUDIO_LATENCY_SAMPLES);
+  if(count)
+  {
+    SM_TRACE("Audio Latency of the last %d Sounds in us, p50 / p95 / p99 / max", count);
+  }
+
+  for(int stage = 0; count && stage < AUDIO_LATENCY_STAGE_COUNT; stage++)
+  {
+    int sorted[AUDIO_LATENCY_SAMPLES];
+    memcpy(sorted, linuxAudio.latency[stage].samples, count * sizeof(int));
+    qsort(sorted, count, sizeof(int), compare_ints);
+    SM_TRACE("  %-6s %7d / %7d / %7d / %7d", stageNames[stage], 
+             sorted[count / 2], sorted[count * 95 / 100], sorted[count * 99 / 100], 
+             sorted[count - 1]);
+  }
+
+  // Overruns are Commands the Queue had no room for, deferred Events are sent later
+  SM_TRACE("Audio: %d Underruns, %d Overruns, %d deferred Events, %d Stream Underruns, "
+           "Buffer %d x %d Frames",
+           linuxAudio.underruns, soundState->droppedCommands, soundState->deferredEvents,
+           linuxAudio.streamUnderruns, linuxAudio.bufferFrames / linuxAudio.periodFrames, 
+           linuxAudio.periodFrames);
+}
+
+void* mixer_thread_proc(void* param)
+{
+  int periodFrames = linuxAudio.periodFrames;
+  int reportFrames = SAMPLE_RATE * 10 / periodFrames * periodFrames;
+
+  // Paced Sinks play like a Device that started at startUs and
+  // holds bufferFrames, the Mixer stays that far ahead of it
+  long long startUs = get_time_us();
+
+  while(true)
+  {
+    // Pick up Commands sent by the Game
+    flush_audio_events();
+    AudioCommand command;
+    long long pickupUs = get_time_us();
+    while(soundState->commands.pop(&command))
+    {
+      mixer_execute_command(command, pickupUs);
+    }
+
+    // Mix one Period
+    double mixStart = linux_get_seconds();
+    memset(linuxAudio.accumulator, 0, periodFrames * NUM_CHANNELS * sizeof(float));
+    mixer_select_audible_voices();
+
+    linuxAudio.newVoiceCount = 0;
+    for(int voiceIdx = 0; voiceIdx < MAX_VIRTUAL_VOICES; voiceIdx++)
+    {
+      MixerVoice* voice = &linuxAudio.voices[voiceIdx];
+      if(!voice->playing)
+      {
+        continue;
+      }
+
+      if(voice->audible && !voice->latencyRecorded)
+      {
+        voice->latencyRecorded = true;
+        linuxAudio.newVoiceEnqueueUs[linuxAudio.newVoiceCount] = voice->enqueueUs;
+        linuxAudio.newVoicePickupUs[linuxAudio.newVoiceCount] = voice->pickupUs;
+        linuxAudio.newVoiceCount++;
+      }
+
+      mixer_mix_voice(voice, voice->audible? linuxAudio.accumulator : nullptr, periodFrames);
+    }
+    mixer_clip_to_int16(linuxAudio.accumulator, linuxAudio.output, 
+                        periodFrames * NUM_CHANNELS);
+    linuxAudio.secondsMixing += linux_get_seconds() - mixStart;
+    linuxAudio.framesMixed += periodFrames;
+
+    if(!linuxAudio.sink.write(&linuxAudio.sink, linuxAudio.output, periodFrames))
+    {
+      SM_ERROR("Mixer: Sink %s failed, falling back to null Sink", linuxAudio.sink.name);
+      make_null_sink(&linuxAudio.sink);
+    }
+    long long writeUs = get_time_us();
+
+    // Frames in front of and including this Period
+    int queuedFrames = periodFrames;
+    bool paced = !linuxAudio.sink.realtime && !linuxAudio.unpaced;
+    if(linuxAudio.sink.queued_frames)
+    {
+      queuedFrames = linuxAudio.sink.queued_frames(&linuxAudio.sink);
+    }
+    else if(paced)
+    {
+      long long playedFrames = (writeUs - startUs) * SAMPLE_RATE / 1000000;
+      queuedFrames = (int)(linuxAudio.framesMixed - playedFrames);
+      if(queuedFrames < periodFrames)
+      {
+        // We didn't keep up, the Device would have played silence
+        if(queuedFrames <= 0)
+        {
+          linuxAudio.underruns++;
+          startUs = writeUs - (linuxAudio.framesMixed - periodFrames) * 1000000 / SAMPLE_RATE;
+        }
+        queuedFrames = periodFrames;
+      }
+    }
+
+    long long deviceUs = (long long)max(queuedFrames - periodFrames, 0) * 1000000 / SAMPLE_RATE;
+    for(int idx = 0; idx < linuxAudio.newVoiceCount; idx++)
+    {
+      long long enqueueUs = linuxAudio.newVoiceEnqueueUs[idx];
+      long long voicePickupUs = linuxAudio.newVoicePickupUs[idx];
+      record_audio_latency(AUDIO_LATENCY_QUEUE, voicePickupUs - enqueueUs);
+      record_audio_latency(AUDIO_LATENCY_MIX, writeUs - voicePickupUs);
+      record_audio_latency(AUDIO_LATENCY_DEVICE, deviceUs);
+      record_audio_latency(AUDIO_LATENCY_TOTAL, writeUs + deviceUs - enqueueUs);
+    }
+
+    // Report every 10 seconds of Audio, headless Sinks also report throughput
+    if(linuxAudio.framesMixed % reportFrames == 0)
+    {
+      if(!linuxAudio.sink.realtime)
+      {
+        double mixedSeconds = (double)linuxAudio.framesMixed / SAMPLE_RATE;
+        SM_TRACE("Mixer: %.1f s of Audio mixed, %.1fx realtime, %d Voices at peak", mixedSeconds,
+                 mixedSeconds / (linuxAudio.secondsMixing + 0.000001), linuxAudio.peakVoices);
+      }
+      report_audio_latency();
+    }
+
+    // Devices block in write(), everything else is paced here
+    if(paced)
+    {
+      long long wakeFrames = linuxAudio.framesMixed - linuxAudio.bufferFrames + periodFrames;
+      long long wakeUs = startUs + wakeFrames * 1000000 / SAMPLE_RATE;
+      long long sleepUs = wakeUs - get_time_us();
+      if(sleepUs > 0)
+      {
+        usleep((useconds_t)sleepUs);
+      }
+    }
+  }
+
+  return nullptr;
+}
+
+// SM_AUDIO_SINK selects the Sink: alsa (default), wav or null
+// SM_AUDIO_WAV_PATH is the output of the wav Sink
+// SM_AUDIO_UNPACED mixes as fast as possible for the wav and null Sinks
+// SM_AUDIO_PERIOD_FRAMES and SM_AUDIO_BUFFER_PERIODS trade latency for
+// robustness, the Device (or the simulated one) holds Periods * Frames
 bool platform_init_audio()
 {
-  // TODO: Linux Audio monakS
+  const char* sinkName = getenv("SM_AUDIO_SINK");
+  sinkName = sinkName? sinkName : "alsa";
+  linuxAudio.unpaced = getenv("SM_AUDIO_UNPACED") != nullptr;
+
+  char* periodFrames = getenv("SM_AUDIO_PERIOD_FRAMES");
+  char* bufferPeriods = getenv("SM_AUDIO_BUFFER_PERIODS");
+  linuxAudio.periodFrames = clamp(periodFrames? atoi(periodFrames) : AUDIO_PERIOD_FRAMES,
+                                  MIN_AUDIO_PERIOD_FRAMES, MAX_AUDIO_PERIOD_FRAMES);
+  linuxAudio.bufferFrames = linuxAudio.periodFrames * 
+                            clamp(bufferPeriods? atoi(bufferPeriods) : AUDIO_BUFFER_PERIODS, 2, 16);
+
+  bool sinkCreated = false;
+  if(strcmp(sinkName, "wav") == 0)
+  {
+    char* wavPath = getenv("SM_AUDIO_WAV_PATH");
+    sinkCreated = make_wav_sink(&linuxAudio.sink, wavPath? wavPath : "audio_out.wav");
+  }
+  else if(strcmp(sinkName, "alsa") == 0)
+  {
+    sinkCreated = make_alsa_sink(&linuxAudio.sink, linuxAudio.bufferFrames);
+  }
+
+  if(!sinkCreated)
+  {
+    SM_WARN("Audio: Using null Sink instead of %s", sinkName);
+    make_null_sink(&linuxAudio.sink);
+  }
+
+  sem_init(&linuxAudio.ioSemaphore, 0, 0);
+  if(pthread_create(&linuxAudio.ioThread, nullptr, io_thread_proc, nullptr) != 0)
+  {
+    SM_ERROR("Audio: Failed to create Streaming I/O Thread");
+    return false;
+  }
+  pthread_detach(linuxAudio.ioThread);
+
+  if(pthread_create(&linuxAudio.thread, nullptr, mixer_thread_proc, nullptr) != 0)
+  {
+    SM_ERROR("Audio: Failed to create Mixer Thread");
+    return false;
+  }
+  pthread_detach(linuxAudio.thread);
+
+  SM_TRACE("Audio: Mixing %d Frames per Period into %s Sink, buffering %d Frames", 
+           linuxAudio.periodFrames, linuxAudio.sink.name, linuxAudio.bufferFrames);
   return true;
 }
 
 void platform_update_audio(float dt)
 {
-  // TODO: Please I don't want to do this!!!!!
-  soundState->playingSounds.clear();
+  // Nothing to do, the Mixer Thread reads soundState->commands directly
+  // and does fades per Frame
 }
 
 void platform_sleep(unsigned int ms)
 {
-  sleep(ms);
+  usleep(ms * 1000);
 }
\ No newline at end of file
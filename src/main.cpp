@@ -4,6 +4,12 @@
 
 #include "game.h"
 
+#include "level_file.h"
+
+#include "rewind.h"
+
+#include "replay.h"
+
 #include "sound.h"
 
 #include "ui.h"
@@ -16,39 +22,102 @@
 //                           Platform Includes
 // #############################################################################
 #include "platform.h"
-#ifdef _WIN32
+#ifdef SM_HEADLESS
+// No Hot Reload without a Window either, ./build.sh headless sets both
+#ifndef SM_RELEASE
+#error "Headless Builds compile the Game in, define SM_RELEASE"
+#endif
+#include "null_platform.cpp"
+#elif defined(_WIN32)
 #include "win32_platform.cpp"
 const char* gameLibName = "game.dll";
-const char* gameLoadLibName = "game_load.dll";
+const char* gameLoadLibFormat = "game_load_%d.dll";
 #elif defined(__APPLE__)
 #include "mac_platform.cpp"
 const char* gameLibName = "game.so"; // ?????
-const char* gameLoadLibName = "game_load.so";
+const char* gameLoadLibFormat = "game_load_%d.so";
 #else // Linux
 #include "linux_platform.cpp"
 const char* gameLibName = "game.so";
-const char* gameLoadLibName = "game_load.so";
+const char* gameLoadLibFormat = "game_load_%d.so";
 #endif
 
 // #############################################################################
 //                           Renderer
 // #############################################################################
+#ifndef SM_HEADLESS
 #include "gl_renderer.cpp"
+#endif
 
 // #############################################################################
 //                           Game DLL Stuff
 // #############################################################################
+#ifdef SM_RELEASE
+// Release Builds compile the Game right in, no Hot Reload
+#include "game.cpp"
+#else
 // This is the function pointer to update_game in game.cpp
 typedef decltype(update_game) update_game_type;
 static update_game_type* update_game_ptr;
 
+static constexpr int GAME_LIBRARY_POLL_MS = 50;
+
+// A freshly loaded game.so, the Phase Timings get logged on swap
+struct GameLibrary
+{
+  void* dll;
+  update_game_type* update;
+  char path[64];
+
+  double copyMs;
+  double loadMs;
+  double resolveMs;
+};
+
+// The Loader Thread publishes staged through pending, the Main Thread
+// swaps it in at the next Frame boundary and clears pending, after
+// that the Loader may reuse staged
+struct GameLibraryLoader
+{
+  GameLibrary current;
+  GameLibrary staged;
+  GameLibrary* pending;
+  int loadCount;
+};
+
+static GameLibraryLoader gameLoader;
+#endif
+
+// #############################################################################
+//                           Job System
+// #############################################################################
+// Lives as long as the Process, its Threads do too
+static JobSystem jobSystem;
+
+// #############################################################################
+//                           Save Worker
+// #############################################################################
+static constexpr int SAVE_WORKER_POLL_MS = 10;
+
+// Encoding needs a Copy of the GameState next to the File Buffer
+static constexpr int SAVE_SCRATCH_SIZE = MAX_LEVEL_FILE_SIZE + sizeof(GameState) + KB(64);
+
 // #############################################################################
 //                           Cross Platform functions
 // #############################################################################
 // Used to get Delta Time
 #include <chrono>
+// Used to hash the persistent Layout
+#include <typeinfo>
 double get_delta_time();
-void reload_game_dll(BumpAllocator* transientStorage);
+unsigned long long fnv1a_hash(void* data, size_t size);
+unsigned long long persistent_layout_hash();
+#ifndef SM_RELEASE
+void game_library_loader_proc(void* data);
+void swap_game_dll();
+#endif
+void save_worker_proc(void* data);
+void bench_huge_pages();
 
 
 int main()
@@ -56,51 +125,151 @@ int main()
   // Initialize timestamp
   get_delta_time();
 
-  BumpAllocator transientStorage = make_bump_allocator(MB(50));
-  BumpAllocator persistentStorage = make_bump_allocator(MB(256));
+#ifndef SM_RELEASE
+  if(!check_pool())
+  {
+    return -1;
+  }
+#endif
+
+  // Frames that needed a lot of transient memory give it back on reset
+  BumpAllocator transientStorage = make_bump_allocator(TRANSIENT_STORAGE_SIZE, MB(8));
+
+#ifndef SM_RELEASE
+  if(!check_level_file(&transientStorage))
+  {
+    return -1;
+  }
+#endif
+
+  // SM_PERSISTENT_FILE=path keeps the persistent Arena in a File,
+  // a restarted Engine picks up the Session where it was
+  BumpAllocator persistentStorage = {};
+  bool resumedSession = false;
+  long long startUs = get_time_us();
+  if(char* persistentFile = getenv("SM_PERSISTENT_FILE"))
+  {
+    persistentStorage = make_file_bump_allocator(persistentFile, PERSISTENT_STORAGE_SIZE,
+                                                 PERSISTENT_BASE_ADDRESS, 
+                                                 persistent_layout_hash(), &resumedSession);
+  }
+
+  // SM_HUGE_PAGES=1 backs the persistent Arena with 2 MB Pages, F11 benchmarks them
+  if(!persistentStorage.memory)
+  {
+    bool hugePages = getenv("SM_HUGE_PAGES") && atoi(getenv("SM_HUGE_PAGES"));
+    persistentStorage = make_bump_allocator(PERSISTENT_STORAGE_SIZE, 0, hugePages);
+    if(hugePages)
+    {
+      SM_TRACE("Persistent Arena Huge Pages: %s", 
+               HUGE_PAGE_MODE_NAMES[persistentStorage.hugePages]);
+    }
+  }
+
+  // F10 dumps usage per Call Site, so does running out of either
+  static BumpAllocatorStats transientStats, persistentStats;
+  bump_track(&transientStorage, &transientStats, "Transient");
+  bump_track(&persistentStorage, &persistentStats, "Persistent");
 
-  input = (Input*)bump_alloc(&persistentStorage, sizeof(Input));
+  input = (Input*)bump_alloc(&persistentStorage, sizeof(Input), ALLOC_TAG_PLATFORM);
   if(!input)
   {
     SM_ERROR("Failed to allocate Input");
     return -1;
   }
 
-  renderData = (RenderData*)bump_alloc(&persistentStorage, sizeof(RenderData));
+  renderData = (RenderData*)bump_alloc(&persistentStorage, sizeof(RenderData), 
+                                       ALLOC_TAG_RENDER);
   if(!renderData)
   {
     SM_ERROR("Failed to allocate RenderData");
     return -1;
   }
 
-  gameState = (GameState*)bump_alloc(&persistentStorage, sizeof(GameState));
+  gameState = (GameState*)bump_alloc(&persistentStorage, sizeof(GameState), ALLOC_TAG_GAME);
   if(!gameState)
   {
     SM_ERROR("Failed to allocate GameState");
     return -1;
   }
 
-  uiState = (UIState*)bump_alloc(&persistentStorage, sizeof(UIState));
+  uiState = (UIState*)bump_alloc(&persistentStorage, sizeof(UIState), ALLOC_TAG_UI);
   if(!uiState)
   {
     SM_ERROR("Failed to allocate UIState")
     return -1;
   }
 
-  soundState = (SoundState*)bump_alloc(&persistentStorage, sizeof(SoundState));
+  saveState = (SaveState*)bump_alloc(&persistentStorage, sizeof(SaveState), ALLOC_TAG_GAME);
+  if(!saveState)
+  {
+    SM_ERROR("Failed to allocate SaveState");
+    return -1;
+  }
+
+  rewindState = (RewindState*)bump_alloc(&persistentStorage, sizeof(RewindState), 
+                                         ALLOC_TAG_GAME);
+  if(!rewindState)
+  {
+    SM_ERROR("Failed to allocate RewindState");
+    return -1;
+  }
+
+  replayState = (ReplayState*)bump_alloc(&persistentStorage, sizeof(ReplayState), 
+                                         ALLOC_TAG_GAME);
+  if(!replayState)
+  {
+    SM_ERROR("Failed to allocate ReplayState");
+    return -1;
+  }
+
+  soundState = (SoundState*)bump_alloc(&persistentStorage, sizeof(SoundState), 
+                                       ALLOC_TAG_SOUND);
   if(!soundState)
   {
     SM_ERROR("Failed to allocate SoundState");
     return -1;
   }
   soundState->transientStorage = &transientStorage;
-  soundState->allocatedsoundsBuffer = bump_alloc(&persistentStorage, SOUNDS_BUFFER_SIZE);
-  if(!soundState->allocatedsoundsBuffer)
+  char* soundsBuffer = bump_alloc(&persistentStorage, SOUNDS_BUFFER_SIZE, ALLOC_TAG_SOUND);
+  if(!soundsBuffer)
   {
     SM_ERROR("Failed to allocated Sounds Buffer");
     return -1;
   }
 
+  if(resumedSession)
+  {
+    // Same Allocations in the same order, so everything is where it was.
+    // Skip over the Buddy Allocator's free Bits instead of clearing them
+    bump_alloc(&persistentStorage, buddy_metadata_size(SOUNDS_BUFFER_SIZE, SOUND_BLOCK_SIZE),
+               ALLOC_TAG_SOUND);
+
+    *input = {};
+    *saveState = {};
+
+    // The Replay File went away with the old Process
+    if(replayState->mode == REPLAY_MODE_PLAYBACK)
+    {
+      replayState->mode = REPLAY_MODE_OFF;
+    }
+    replayState->file = nullptr;
+    replayState->fileMapped = false;
+    resume_sounds();
+    SM_TRACE("Resumed Session in %.2f ms", (get_time_us() - startUs) / 1000.0);
+  }
+  else
+  {
+    soundState->soundsAllocator = make_buddy_allocator(soundsBuffer, SOUNDS_BUFFER_SIZE, 
+                                                       SOUND_BLOCK_SIZE, &persistentStorage);
+    if(!soundState->soundsAllocator.memory)
+    {
+      SM_ERROR("Failed to allocate Sounds Allocator");
+      return -1;
+    }
+    soundState->cacheBudget = SOUND_CACHE_BUDGET;
+  }
+
   platform_create_window(1280, 720, "Schnitzel Motor");
   platform_fill_keycode_lookup_table();
   platform_set_vsync(true);
@@ -110,38 +279,167 @@ int main()
     return -1;
   }
 
+  // SM_REPLAY=path plays a Replay back from the first Frame on,
+  // Headless Builds play it as fast as they can and quit after
+  if(char* replayFile = getenv("SM_REPLAY"))
+  {
+    request_replay(REPLAY_MODE_PLAYBACK, replayFile);
+  }
+
+  // SM_REPLAY_SEEK=tick seeks there right after the Replay started
+  if(char* seekTick = getenv("SM_REPLAY_SEEK"))
+  {
+    request_replay_seek(atoi(seekTick));
+  }
+
+#ifdef SM_HEADLESS
+  if(replayState->requestedMode != REPLAY_MODE_PLAYBACK)
+  {
+    SM_ERROR("Headless Builds play a Replay, set SM_REPLAY=path");
+    return -1;
+  }
+#else
   gl_init(&transientStorage);
+#endif
+
+  if(!platform_create_thread(save_worker_proc, saveState))
+  {
+    SM_ERROR("Failed to create the Save Worker Thread");
+    return -1;
+  }
+
+  // Worker 0 is the Main Thread
+  if(!init_job_system(&jobSystem, job_default_worker_count()))
+  {
+    SM_ERROR("Failed to reserve the Job Worker Arenas");
+    return -1;
+  }
+  for(int workerIdx = 1; workerIdx < jobSystem.workerCount; workerIdx++)
+  {
+    if(!platform_create_thread(job_worker_proc, &jobSystem.workers[workerIdx]))
+    {
+      SM_ERROR("Failed to create Job Worker Thread %d", workerIdx);
+      return -1;
+    }
+  }
+  SM_TRACE("Job System: %d Workers", jobSystem.workerCount);
+
+#ifndef SM_RELEASE
+  if(!platform_create_thread(game_library_loader_proc, nullptr))
+  {
+    SM_ERROR("Failed to create the Game Library Loader Thread");
+    return -1;
+  }
+
+  // The first Frame needs update_game
+  while(!update_game_ptr)
+  {
+    platform_sleep(1);
+    swap_game_dll();
+  }
+#endif
 
   while(running)
   {
+#ifdef SM_HEADLESS
+    // Exactly one Tick per Frame, no waiting on the Clock
+    float dt = UPDATE_DELAY;
+#else
     float dt = get_delta_time();
+#endif
 
-    reload_game_dll(&transientStorage);
+#ifndef SM_RELEASE
+    swap_game_dll();
+#endif
 
     // Update
     platform_update_window();
-    update_game(gameState, input, renderData, soundState, uiState, &transientStorage, dt);
+
+    // update_game() clears Key Transitions only after a Tick, the Tools
+    // consume their Press or a Frame without a Tick runs them again
+    bool reportArenas = key_consume_press(KEY_F10);
+    bool benchHugePages = key_consume_press(KEY_F11);
+    bool benchJobs = key_consume_press(KEY_F12);
+
+    update_game(gameState, input, renderData, soundState, uiState, saveState, rewindState,
+                replayState, &transientStorage, dt);
+#ifdef SM_HEADLESS
+    // Nothing draws them, don't let them pile up
+    renderData->transforms.clear();
+    renderData->transparentTransforms.clear();
+    renderData->uiTransforms.clear();
+    renderData->uiTransparentTransforms.clear();
+#else
     gl_render();
+#endif
     platform_update_audio(dt);
 
     platform_swap_buffers();
 
-    transientStorage.used = 0;
+    if(reportArenas)
+    {
+      bump_report(&transientStorage);
+      bump_report(&persistentStorage);
+    }
+
+    if(benchHugePages)
+    {
+      bench_huge_pages();
+    }
+
+    if(benchJobs && check_jobs(&jobSystem))
+    {
+      bench_jobs(&jobSystem);
+    }
+
+    // Every Job is done by now, their Arenas go with the transient Storage
+    bump_reset(&transientStorage);
+    job_system_reset_arenas(&jobSystem);
+
+#ifdef SM_HEADLESS
+    // The Hash has to match between Runs of the same Replay, Seeks included.
+    // updateTimer is Frame Pacing, it depends on how many Frames ran
+    if(replayState->finished)
+    {
+      if(replayState->failed)
+      {
+        return -1;
+      }
+
+      GameState* hashed = (GameState*)bump_alloc(&transientStorage, sizeof(GameState),
+                                                 ALLOC_TAG_PLATFORM);
+      *hashed = *gameState;
+      hashed->updateTimer = 0.0;
+
+      double playbackMs = (get_time_us() - replayState->startUs) / 1000.0;
+      SM_TRACE("Headless Replay %s: %d Ticks in %.2f ms, %.2f us per Tick, "
+               "GameState Hash %016llx", replayState->path, replayState->tick, playbackMs,
+               replayState->tick? playbackMs * 1000.0 / replayState->tick : 0.0,
+               fnv1a_hash(hashed, sizeof(GameState)));
+      return 0;
+    }
+#endif
   }
 
   return 0;
 }
 
+#ifndef SM_RELEASE
 void update_game(GameState* gameStateIn, 
                 Input* inputIn,
                 RenderData* renderDataIn, 
                 SoundState* soundStateIn,
                 UIState* uiStateIn,
+                SaveState* saveStateIn,
+                RewindState* rewindStateIn,
+                ReplayState* replayStateIn,
                 BumpAllocator* transientStorageIn,
                 float dt)
 {
-  update_game_ptr(gameStateIn, inputIn, renderDataIn, soundStateIn, uiStateIn, transientStorageIn, dt);
+  update_game_ptr(gameStateIn, inputIn, renderDataIn, soundStateIn, uiStateIn, saveStateIn,
+                  rewindStateIn, replayStateIn, transientStorageIn, dt);
 }
+#endif
 
 double get_delta_time()
 {
@@ -157,36 +455,478 @@ double get_delta_time()
 }
 
 
-void reload_game_dll(BumpAllocator* transientStorage)
+#ifndef SM_RELEASE
+// Stages, loads and resolves a new game.so whenever the Build Output changes,
+// the Main Thread only has to swap a Pointer
+void game_library_loader_proc(void* data)
 {
-  static void* gameDLL;
-  static long long lastEditTimestampGameDLL;
-
-  long long currentTimestampGameDLL = get_timestamp(gameLibName);
-  if(currentTimestampGameDLL > lastEditTimestampGameDLL)
+  long long lastEditTimestampGameDLL = 0;
+  while(true)
   {
-    if(gameDLL)
+    long long currentTimestampGameDLL = get_timestamp(gameLibName);
+    if(currentTimestampGameDLL <= lastEditTimestampGameDLL ||
+       __atomic_load_n(&gameLoader.pending, __ATOMIC_ACQUIRE))
     {
-      bool freeResult = platform_free_dynamic_library(gameDLL);
-      SM_ASSERT(freeResult, "Failed to free %s", gameLibName);
-      gameDLL = nullptr;
-      SM_TRACE("Freed %s", gameLibName);
+      platform_sleep(GAME_LIBRARY_POLL_MS);
+      continue;
     }
 
-    while(!copy_file(gameLibName, gameLoadLibName, transientStorage))
+    // The old Library stays loaded until the swap, and loading the same
+    // path again would just hand it back, so every Copy gets its own Name
+    GameLibrary* staged = &gameLoader.staged;
+    *staged = {};
+    sprintf(staged->path, gameLoadLibFormat, gameLoader.loadCount++);
+
+    // Never load the Build Output directly, the Compiler has to be able to
+    // overwrite it. Fails while the Build is still writing it
+    long long startUs = get_time_us();
+    while(!platform_copy_file(gameLibName, staged->path))
     {
       platform_sleep(10);
     }
-    SM_TRACE("Copied %s into %s", gameLibName, gameLoadLibName);
+    long long copiedUs = get_time_us();
+
+    staged->dll = platform_load_dynamic_library(staged->path);
+    SM_ASSERT(staged->dll, "Failed to load %s", staged->path);
+    long long loadedUs = get_time_us();
 
-    gameDLL = platform_load_dynamic_library(gameLoadLibName);
-    SM_ASSERT(gameDLL, "Failed to load %s", gameLoadLibName);
+    staged->update = (update_game_type*)platform_load_dynamic_function(staged->dll, "update_game");
+    SM_ASSERT(staged->update, "Failed to load update_game function");
+    long long resolvedUs = get_time_us();
 
-    update_game_ptr = (update_game_type*)platform_load_dynamic_function(gameDLL, "update_game");
-    SM_ASSERT(update_game_ptr, "Failed to load update_game function");
+    staged->copyMs = (copiedUs - startUs) / 1000.0;
+    staged->loadMs = (loadedUs - copiedUs) / 1000.0;
+    staged->resolveMs = (resolvedUs - loadedUs) / 1000.0;
     lastEditTimestampGameDLL = currentTimestampGameDLL;
+
+    __atomic_store_n(&gameLoader.pending, staged, __ATOMIC_RELEASE);
+  }
+}
+
+// Called between Frames, no Code of the old Library is running
+void swap_game_dll()
+{
+  GameLibrary* pending = __atomic_load_n(&gameLoader.pending, __ATOMIC_ACQUIRE);
+  if(!pending)
+  {
+    return;
+  }
+
+  long long swapStartUs = get_time_us();
+  GameLibrary oldLibrary = gameLoader.current;
+  gameLoader.current = *pending;
+  update_game_ptr = gameLoader.current.update;
+  __atomic_store_n(&gameLoader.pending, nullptr, __ATOMIC_RELEASE);
+  long long swappedUs = get_time_us();
+
+  if(oldLibrary.dll)
+  {
+    bool freeResult = platform_free_dynamic_library(oldLibrary.dll);
+    SM_ASSERT(freeResult, "Failed to free %s", oldLibrary.path);
+    remove(oldLibrary.path);
+  }
+  long long closedUs = get_time_us();
+
+  GameLibrary* library = &gameLoader.current;
+  SM_TRACE("Loaded %s: copy %.2f ms, load %.2f ms, resolve %.2f ms off Thread, "
+           "swap %.3f ms, close old %.2f ms", library->path, library->copyMs, library->loadMs,
+           library->resolveMs, (swappedUs - swapStartUs) / 1000.0, (closedUs - swappedUs) / 1000.0);
+}
+#endif
+
+// Runs outside of game.so, a Hot Reload can't pull the Code out from under it.
+// Holds on to the SaveState it was started with, not the saveState Global
+void save_worker_proc(void* data)
+{
+  SaveState* save = (SaveState*)data;
+  BumpAllocator scratch = make_bump_allocator(SAVE_SCRATCH_SIZE);
+  SM_ASSERT(scratch.memory, "Failed to allocate Save Scratch Memory");
+
+  while(true)
+  {
+    if(__atomic_load_n(&save->status, __ATOMIC_ACQUIRE) != SAVE_STATUS_QUEUED)
+    {
+      platform_sleep(SAVE_WORKER_POLL_MS);
+      continue;
+    }
+    __atomic_store_n(&save->status, SAVE_STATUS_WRITING, __ATOMIC_RELAXED);
+
+    long long startUs = get_time_us();
+    char* buffer = bump_alloc(&scratch, MAX_LEVEL_FILE_SIZE, ALLOC_TAG_GAME);
+    int size = buffer? encode_save(save, buffer, MAX_LEVEL_FILE_SIZE, &scratch) : 0;
+    long long encodedUs = get_time_us();
+
+    bool written = size && platform_write_file_atomic(save->path, buffer, size);
+    long long writtenUs = get_time_us();
+    bump_reset(&scratch);
+
+    save->fileSize = size;
+    save->encodeMs = (encodedUs - startUs) / 1000.0;
+    save->writeMs = (writtenUs - encodedUs) / 1000.0;
+    if(written)
+    {
+      SM_TRACE("Saved %s, %d Bytes: snapshot %.3f ms on the Game Thread, "
+               "encode %.2f ms, write %.2f ms on the Save Worker", save->path, size,
+               save->snapshotMs, save->encodeMs, save->writeMs);
+    }
+    else
+    {
+      SM_ERROR("Failed saving %s", save->path);
+    }
+
+    __atomic_store_n(&save->status, written? SAVE_STATUS_DONE : SAVE_STATUS_FAILED,
+                     __ATOMIC_RELEASE);
+  }
+}
+
+// F11, plays Frames from a Copy of the Session, once out of an Arena with 4 KB
+// Pages and once with Huge Pages. Saves and Replays start out empty in the
+// Copy, the Save Worker and open Replay Files never see the Benchmark.
+// game.so only rebinds its Globals when the transient Arena changes, every
+// Copy gets its own, the next live Frame rebinds back to the Session
+void bench_huge_pages()
+{
+  constexpr int WARMUP_FRAMES = 10;
+  constexpr int FRAME_COUNT = 120;
+
+  // The Copy shares the Mixer with the Session, it stays silent
+  bool liveMuted = soundState->muted;
+  soundState->muted = true;
+
+  Input* liveInput = input;
+  RenderData* liveRenderData = renderData;
+  GameState* liveGameState = gameState;
+  UIState* liveUIState = uiState;
+  SaveState* liveSaveState = saveState;
+  RewindState* liveRewindState = rewindState;
+  ReplayState* liveReplayState = replayState;
+
+  BumpAllocator benchTransientStorages[2] = {};
+  for(int useHugePages = 0; useHugePages < 2; useHugePages++)
+  {
+    BumpAllocator arena = make_bump_allocator(PERSISTENT_STORAGE_SIZE, 0, useHugePages);
+    BumpAllocator* benchTransientStorage = &benchTransientStorages[useHugePages];
+    *benchTransientStorage = make_bump_allocator(TRANSIENT_STORAGE_SIZE, MB(8));
+    input = (Input*)bump_alloc(&arena, sizeof(Input), ALLOC_TAG_PLATFORM);
+    renderData = (RenderData*)bump_alloc(&arena, sizeof(RenderData), ALLOC_TAG_RENDER);
+    gameState = (GameState*)bump_alloc(&arena, sizeof(GameState), ALLOC_TAG_GAME);
+    uiState = (UIState*)bump_alloc(&arena, sizeof(UIState), ALLOC_TAG_UI);
+    saveState = (SaveState*)bump_alloc(&arena, sizeof(SaveState), ALLOC_TAG_GAME);
+    rewindState = (RewindState*)bump_alloc(&arena, sizeof(RewindState), ALLOC_TAG_GAME);
+    replayState = (ReplayState*)bump_alloc(&arena, sizeof(ReplayState), ALLOC_TAG_GAME);
+    if(!replayState || !benchTransientStorage->memory)
+    {
+      SM_ERROR("Huge Pages: Failed to allocate the Benchmark Arena");
+      free_bump_allocator(&arena);
+      free_bump_allocator(benchTransientStorage);
+      break;
+    }
+
+    // Nobody presses anything in the Copy
+    memcpy(input, liveInput, sizeof(Input));
+    memset(input->keys, 0, sizeof(input->keys));
+    input->relMouse = {};
+    memcpy(renderData, liveRenderData, sizeof(RenderData));
+    memcpy(gameState, liveGameState, sizeof(GameState));
+    memcpy(uiState, liveUIState, sizeof(UIState));
+    memcpy(rewindState, liveRewindState, sizeof(RewindState));
+
+    double totalMs = 0.0;
+    double slowestFrameMs = 0.0;
+    for(int frameIdx = 0; frameIdx < WARMUP_FRAMES + FRAME_COUNT; frameIdx++)
+    {
+      long long frameStartUs = get_time_us();
+      update_game(gameState, input, renderData, soundState, uiState, saveState, rewindState,
+                  replayState, benchTransientStorage, UPDATE_DELAY);
+#ifdef SM_HEADLESS
+      renderData->transforms.clear();
+      renderData->transparentTransforms.clear();
+      renderData->uiTransforms.clear();
+      renderData->uiTransparentTransforms.clear();
+#else
+      gl_render();
+#endif
+      double frameMs = (get_time_us() - frameStartUs) / 1000.0;
+      bump_reset(benchTransientStorage);
+
+      // The first Frames fault the Copy in
+      if(frameIdx >= WARMUP_FRAMES)
+      {
+        totalMs += frameMs;
+        slowestFrameMs = frameMs > slowestFrameMs? frameMs : slowestFrameMs;
+      }
+    }
+
+    SM_TRACE("Huge Pages %s (%s, %.1f MB granted): update_game + gl_render "
+             "%.3f ms/frame avg, %.3f ms worst over %d Frames", useHugePages? "on" : "off", 
+             HUGE_PAGE_MODE_NAMES[arena.hugePages], bump_huge_page_bytes(&arena) / (1024.0 * 1024.0),
+             totalMs / FRAME_COUNT, slowestFrameMs, FRAME_COUNT);
+    free_bump_allocator(&arena);
+    free_bump_allocator(benchTransientStorage);
+  }
+
+  input = liveInput;
+  renderData = liveRenderData;
+  gameState = liveGameState;
+  uiState = liveUIState;
+  saveState = liveSaveState;
+  rewindState = liveRewindState;
+  replayState = liveReplayState;
+  soundState->muted = liveMuted;
+}
+
+// Every Struct that lives in the persistent Arena, and the ones they hold by
+// Value, with all of their Fields in Order. The Containers are the same for
+// every Element Type, their Type Names carry the Element Type and Size
+#define PERSISTENT_LAYOUT(STRUCT, FIELD)                                                \
+  STRUCT(Input)                                                                         \
+  FIELD(Input, screenSize) FIELD(Input, relMouse) FIELD(Input, prevMousePos)            \
+  FIELD(Input, mousePos) FIELD(Input, prevMousePosWorld) FIELD(Input, mousePosWorld)    \
+  FIELD(Input, relMouseWorld) FIELD(Input, keys)                                        \
+                                                                                        \
+  STRUCT(Key)                                                                           \
+  FIELD(Key, isDown) FIELD(Key, justPressed) FIELD(Key, justReleased)                   \
+  FIELD(Key, halfTransitionCount)                                                       \
+                                                                                        \
+  STRUCT(RenderData)                                                                    \
+  FIELD(RenderData, clearColor) FIELD(RenderData, glyphs)                               \
+  FIELD(RenderData, gameCamera) FIELD(RenderData, uiCamera)                             \
+  FIELD(RenderData, orthoProjectionGame) FIELD(RenderData, orthoProjectionUI)           \
+  FIELD(RenderData, transforms) FIELD(RenderData, transparentTransforms)                \
+  FIELD(RenderData, uiTransforms) FIELD(RenderData, uiTransparentTransforms)            \
+                                                                                        \
+  STRUCT(OrthographicCamera2D)                                                          \
+  FIELD(OrthographicCamera2D, zoom) FIELD(OrthographicCamera2D, dimensions)             \
+  FIELD(OrthographicCamera2D, position)                                                 \
+                                                                                        \
+  STRUCT(Glyph)                                                                         \
+  FIELD(Glyph, size) FIELD(Glyph, offset) FIELD(Glyph, advance)                         \
+  FIELD(Glyph, textureCoords)                                                           \
+                                                                                        \
+  STRUCT(Transform)                                                                     \
+  FIELD(Transform, pos) FIELD(Transform, size) FIELD(Transform, atlasOffset)            \
+  FIELD(Transform, spriteSize) FIELD(Transform, renderOptions) FIELD(Transform, layer)  \
+                                                                                        \
+  STRUCT(GameState)                                                                     \
+  FIELD(GameState, state) FIELD(GameState, updateTimer) FIELD(GameState, initialized)   \
+  FIELD(GameState, cameraPos) FIELD(GameState, cameraStartPos)                          \
+  FIELD(GameState, cameraEndPos) FIELD(GameState, cameraTimer)                          \
+  FIELD(GameState, gameInput) FIELD(GameState, player) FIELD(GameState, level)          \
+  FIELD(GameState, jumpSound) FIELD(GameState, deathSound)                              \
+                                                                                        \
+  STRUCT(GameInput)                                                                     \
+  FIELD(GameInput, isDown) FIELD(GameInput, justPressed)                                \
+  FIELD(GameInput, bufferingTime)                                                       \
+                                                                                        \
+  STRUCT(Player)                                                                        \
+  FIELD(Player, pos) FIELD(Player, prevPos) FIELD(Player, solidSpeed)                   \
+  FIELD(Player, renderOptions) FIELD(Player, deathAnimTimer)                            \
+  FIELD(Player, runAnimTimer) FIELD(Player, animationState)                             \
+  FIELD(Player, animationSprites) FIELD(Player, speed) FIELD(Player, remainder)         \
+  FIELD(Player, varJumpTimer) FIELD(Player, wallJumpTimer) FIELD(Player, dashTimer)     \
+  FIELD(Player, grounded) FIELD(Player, grabbingWall) FIELD(Player, dashCounter)        \
+                                                                                        \
+  STRUCT(Level)                                                                         \
+  FIELD(Level, version) FIELD(Level, playerStartPos) FIELD(Level, tileMap)              \
+  FIELD(Level, bgTileMap) FIELD(Level, solids)                                          \
+                                                                                        \
+  STRUCT(TileMap)                                                                       \
+  FIELD(TileMap, tileset) FIELD(TileMap, tiles)                                         \
+                                                                                        \
+  STRUCT(Tileset)                                                                       \
+  FIELD(Tileset, tileCoords)                                                            \
+                                                                                        \
+  STRUCT(Tile)                                                                          \
+  FIELD(Tile, type) FIELD(Tile, neighbourMask)                                          \
+                                                                                        \
+  STRUCT(Solid)                                                                         \
+  FIELD(Solid, spriteID) FIELD(Solid, prevRemainder) FIELD(Solid, remainder)            \
+  FIELD(Solid, prevPos) FIELD(Solid, pos) FIELD(Solid, keyframeIdx)                     \
+  FIELD(Solid, keyframes) FIELD(Solid, time) FIELD(Solid, waitingTime)                  \
+  FIELD(Solid, waitingDuration)                                                         \
+                                                                                        \
+  STRUCT(Keyframe)                                                                      \
+  FIELD(Keyframe, pos) FIELD(Keyframe, time)                                            \
+                                                                                        \
+  STRUCT(UIState)                                                                       \
+  FIELD(UIState, tick) FIELD(UIState, hotLastFrame) FIELD(UIState, hotThisFrame)        \
+  FIELD(UIState, active) FIELD(UIState, texts) FIELD(UIState, uiElements)               \
+                                                                                        \
+  STRUCT(UIID)                                                                          \
+  FIELD(UIID, ID) FIELD(UIID, layer)                                                    \
+                                                                                        \
+  STRUCT(UIElement)                                                                     \
+  FIELD(UIElement, ID) FIELD(UIElement, lastTick) FIELD(UIElement, spriteID)            \
+  FIELD(UIElement, pos) FIELD(UIElement, rect) FIELD(UIElement, transform)              \
+                                                                                        \
+  STRUCT(UIText)                                                                        \
+  FIELD(UIText, ID) FIELD(UIText, lastTick) FIELD(UIText, charCount)                    \
+  FIELD(UIText, text) FIELD(UIText, pos) FIELD(UIText, transforms)                      \
+                                                                                        \
+  STRUCT(SoundState)                                                                    \
+  FIELD(SoundState, soundsAllocator) FIELD(SoundState, cacheBudget)                     \
+  FIELD(SoundState, cachedBytes) FIELD(SoundState, playCounter)                         \
+  FIELD(SoundState, cacheHits) FIELD(SoundState, cacheMisses)                           \
+  FIELD(SoundState, cacheEvictions) FIELD(SoundState, mappedBytes)                      \
+  FIELD(SoundState, transientStorage) FIELD(SoundState, allocatedSounds)                \
+  FIELD(SoundState, soundSlots) FIELD(SoundState, commands) FIELD(SoundState, events)   \
+  FIELD(SoundState, droppedCommands) FIELD(SoundState, deferredEvents)                  \
+  FIELD(SoundState, unsentFinishedCount) FIELD(SoundState, unsentFinished)              \
+  FIELD(SoundState, muted)                                                              \
+                                                                                        \
+  STRUCT(Sound)                                                                         \
+  FIELD(Sound, path) FIELD(Sound, pathHash) FIELD(Sound, size) FIELD(Sound, data)       \
+  FIELD(Sound, lastPlayed) FIELD(Sound, streaming) FIELD(Sound, dataOffset)             \
+  FIELD(Sound, mapped) FIELD(Sound, mapping) FIELD(Sound, mappingSize)                  \
+  FIELD(Sound, playingVoices)                                                           \
+                                                                                        \
+  STRUCT(AudioCommand)                                                                  \
+  FIELD(AudioCommand, type) FIELD(AudioCommand, sound) FIELD(AudioCommand, options)     \
+  FIELD(AudioCommand, volume) FIELD(AudioCommand, priority)                             \
+  FIELD(AudioCommand, enqueueUs)                                                        \
+                                                                                        \
+  STRUCT(AudioEvent)                                                                    \
+  FIELD(AudioEvent, type) FIELD(AudioEvent, sound)                                      \
+                                                                                        \
+  STRUCT(BuddyAllocator)                                                                \
+  FIELD(BuddyAllocator, memory) FIELD(BuddyAllocator, capacity)                         \
+  FIELD(BuddyAllocator, minBlockSize) FIELD(BuddyAllocator, maxOrder)                   \
+  FIELD(BuddyAllocator, freeLists) FIELD(BuddyAllocator, freeBits)                      \
+                                                                                        \
+  STRUCT(SaveState)                                                                     \
+  FIELD(SaveState, status) FIELD(SaveState, kind) FIELD(SaveState, path)                \
+  FIELD(SaveState, snapshot) FIELD(SaveState, snapshotMs) FIELD(SaveState, encodeMs)    \
+  FIELD(SaveState, writeMs) FIELD(SaveState, fileSize) FIELD(SaveState, resultTimer)    \
+                                                                                        \
+  STRUCT(RewindState)                                                                   \
+  FIELD(RewindState, firstFrame) FIELD(RewindState, frameCount)                         \
+  FIELD(RewindState, needsKeyframe) FIELD(RewindState, writeOffset)                     \
+  FIELD(RewindState, frames) FIELD(RewindState, data) FIELD(RewindState, keyframe)      \
+  FIELD(RewindState, recordMs) FIELD(RewindState, restoreMs)                            \
+                                                                                        \
+  STRUCT(RewindFrame)                                                                   \
+  FIELD(RewindFrame, offset) FIELD(RewindFrame, size) FIELD(RewindFrame, keyframe)      \
+                                                                                        \
+  STRUCT(ReplayState)                                                                   \
+  FIELD(ReplayState, mode) FIELD(ReplayState, path) FIELD(ReplayState, requestedMode)   \
+  FIELD(ReplayState, requestedPath) FIELD(ReplayState, finished)                        \
+  FIELD(ReplayState, failed) FIELD(ReplayState, tickCount) FIELD(ReplayState, tick)     \
+  FIELD(ReplayState, bitCount) FIELD(ReplayState, bitIdx)                               \
+  FIELD(ReplayState, lastInput) FIELD(ReplayState, startUs)                             \
+  FIELD(ReplayState, seekRequested) FIELD(ReplayState, seekTick)                        \
+  FIELD(ReplayState, seekSimulatedTicks) FIELD(ReplayState, seekMs)                     \
+  FIELD(ReplayState, seeking) FIELD(ReplayState, file) FIELD(ReplayState, fileSize)     \
+  FIELD(ReplayState, fileMapped) FIELD(ReplayState, startState)                         \
+  FIELD(ReplayState, keyframeCount) FIELD(ReplayState, keyframes)                       \
+  FIELD(ReplayState, keyframeDataSize) FIELD(ReplayState, bits)                         \
+  FIELD(ReplayState, keyframeData)                                                      \
+                                                                                        \
+  STRUCT(ReplayKeyframe)                                                                \
+  FIELD(ReplayKeyframe, tick) FIELD(ReplayKeyframe, bitIdx)                             \
+  FIELD(ReplayKeyframe, lastInput) FIELD(ReplayKeyframe, offset)                        \
+  FIELD(ReplayKeyframe, size)                                                           \
+                                                                                        \
+  STRUCT(decltype(RenderData::transforms))                                              \
+  FIELD(decltype(RenderData::transforms), count)                                        \
+  FIELD(decltype(RenderData::transforms), elements)                                     \
+                                                                                        \
+  STRUCT(decltype(Level::solids))                                                       \
+  FIELD(decltype(Level::solids), count) FIELD(decltype(Level::solids), slotCount)       \
+  FIELD(decltype(Level::solids), elements) FIELD(decltype(Level::solids), denseToSlot)  \
+  FIELD(decltype(Level::solids), slotToDense)                                           \
+  FIELD(decltype(Level::solids), generations)                                           \
+                                                                                        \
+  STRUCT(decltype(SoundState::commands))                                                \
+  FIELD(decltype(SoundState::commands), head)                                           \
+  FIELD(decltype(SoundState::commands), headPadding)                                    \
+  FIELD(decltype(SoundState::commands), tail)                                           \
+  FIELD(decltype(SoundState::commands), tailPadding)                                    \
+  FIELD(decltype(SoundState::commands), elements)
+
+// Offset, Size and Type of a Field, reordering Fields or changing their
+// Type changes the Hash even when the Struct keeps its Size
+#define LAYOUT_STRUCT(Struct) sizeof(Struct),
+#define LAYOUT_FIELD(Struct, field)                                                 \
+  offsetof(Struct, field), sizeof(((Struct*)0)->field),                           \
+  (size_t)fnv1a_hash((void*)typeid(((Struct*)0)->field).name(),                   \
+                     strlen(typeid(((Struct*)0)->field).name())),
+
+// Ties PERSISTENT_LAYOUT to the Structs, see layout_lists_every_field()
+struct LayoutSpan
+{
+  bool isStruct;
+  size_t offset;
+  size_t size;
+  size_t structSize;
+  size_t structAlign;
+};
+
+#define LAYOUT_SPAN_STRUCT(Struct) {true, 0, 0, sizeof(Struct), alignof(Struct)},
+#define LAYOUT_SPAN_FIELD(Struct, field)                                            \
+  {false, offsetof(Struct, field), sizeof(((Struct*)0)->field), sizeof(Struct), alignof(Struct)},
+
+constexpr LayoutSpan PERSISTENT_LAYOUT_SPANS[] =
+{
+  PERSISTENT_LAYOUT(LAYOUT_SPAN_STRUCT, LAYOUT_SPAN_FIELD)
+};
+
+// Every Field has to start where the one before ended, plus less Padding than
+// the Struct's Alignment, and the last one has to reach the End of the Struct.
+// A Field that was added to a Struct but not to the List leaves a Gap
+constexpr bool layout_lists_every_field(const LayoutSpan* spans, int count)
+{
+  size_t end = 0;
+  for(int spanIdx = 0; spanIdx <= count; spanIdx++)
+  {
+    if(spanIdx == count || spans[spanIdx].isStruct)
+    {
+      const LayoutSpan& last = spans[spanIdx - 1];
+      if(spanIdx && (last.isStruct || last.structSize - end >= last.structAlign))
+      {
+        return false;
+      }
+      end = 0;
+      continue;
+    }
+
+    const LayoutSpan& field = spans[spanIdx];
+    if(field.offset < end || field.offset - end >= field.structAlign)
+    {
+      return false;
+    }
+    end = field.offset + field.size;
   }
+  return true;
 }
 
+static_assert(layout_lists_every_field(PERSISTENT_LAYOUT_SPANS, ArraySize(PERSISTENT_LAYOUT_SPANS)),
+              "A persistent Struct has a Field PERSISTENT_LAYOUT doesn't list");
+
+// Bump PERSISTENT_LAYOUT_VERSION when a Field keeps its Layout but changes Meaning
+unsigned long long persistent_layout_hash()
+{
+  size_t layout[] =
+  {
+    PERSISTENT_LAYOUT_VERSION,
+    PERSISTENT_STORAGE_SIZE,
+    SOUNDS_BUFFER_SIZE,
+    SOUND_BLOCK_SIZE,
+
+    PERSISTENT_LAYOUT(LAYOUT_STRUCT, LAYOUT_FIELD)
+  };
 
+  return fnv1a_hash(layout, sizeof(layout));
+}
 
+unsigned long long fnv1a_hash(void* data, size_t size)
+{
+  unsigned long long hash = 14695981039346656037ull;
+  unsigned char* bytes = (unsigned char*)data;
+  for(size_t byteIdx = 0; byteIdx < size; byteIdx++)
+  {
+    hash ^= bytes[byteIdx];
+    hash *= 1099511628211ull;
+  }
+
+  return hash;
+}
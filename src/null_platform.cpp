@@ -0,0 +1,138 @@
+#include "schnitzel_lib.h"
+#include "input.h"
+#include "platform.h"
+#include "sound.h"
+
+#include <thread> // for the Save Worker
+
+// #############################################################################
+//                           Null Platform
+// #############################################################################
+// No Window, no Input, no Audio Device. Headless Builds run on this to play
+// Replays back as fast as the Game updates
+
+// #############################################################################
+//                           Platform Implementations
+// #############################################################################
+bool platform_create_window(int width, int height, char* title)
+{
+  return true;
+}
+
+void platform_update_window()
+{
+}
+
+void* platform_load_gl_func(char* funName)
+{
+  return nullptr;
+}
+
+void platform_swap_buffers()
+{
+}
+
+void platform_set_vsync(bool vSync)
+{
+}
+
+// Headless Builds compile the Game in, there is nothing to load
+void* platform_load_dynamic_library(const char* dll)
+{
+  return nullptr;
+}
+
+void* platform_load_dynamic_function(void* dll, const char* funName)
+{
+  return nullptr;
+}
+
+bool platform_free_dynamic_library(void* dll)
+{
+  return true;
+}
+
+bool platform_copy_file(const char* fileName, const char* outputName)
+{
+  FILE* input = fopen(fileName, "rb");
+  FILE* output = input? fopen(outputName, "wb") : nullptr;
+  if(!output)
+  {
+    if(input)
+    {
+      fclose(input);
+    }
+    return false;
+  }
+
+  char buffer[KB(64)];
+  size_t readBytes;
+  bool copied = true;
+  while((readBytes = fread(buffer, 1, sizeof(buffer), input)) > 0)
+  {
+    copied &= fwrite(buffer, 1, readBytes, output) == readBytes;
+  }
+
+  fclose(input);
+  copied &= fclose(output) == 0;
+  return copied;
+}
+
+// No fsync in plain C, the rename is still atomic where the OS allows it
+bool platform_write_file_atomic(const char* fileName, char* buffer, int size)
+{
+  char tmpName[256];
+  snprintf(tmpName, sizeof(tmpName), "%s.tmp", fileName);
+
+  FILE* file = fopen(tmpName, "wb");
+  if(!file)
+  {
+    return false;
+  }
+
+  bool written = fwrite(buffer, 1, size, file) == (size_t)size;
+  written &= fclose(file) == 0;
+  if(!written || rename(tmpName, fileName) != 0)
+  {
+    remove(tmpName);
+    return false;
+  }
+
+  return true;
+}
+
+// Detached, runs until the Process exits
+bool platform_create_thread(PlatformThreadProc threadProc, void* data)
+{
+  std::thread(threadProc, data).detach();
+  return true;
+}
+
+void platform_fill_keycode_lookup_table()
+{
+}
+
+bool platform_init_audio()
+{
+  SM_TRACE("Audio: Null Platform, Sounds finish as soon as they start");
+  return true;
+}
+
+// Nothing plays, every Voice finishes right away so the Game's Counters add up
+void platform_update_audio(float dt)
+{
+  flush_audio_events();
+  AudioCommand command;
+  while(soundState->commands.pop(&command))
+  {
+    if(command.type == AUDIO_COMMAND_PLAY)
+    {
+      push_audio_event({AUDIO_EVENT_VOICE_FINISHED, command.sound});
+    }
+  }
+}
+
+void platform_sleep(unsigned int ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
@@ -5,16 +5,19 @@
 // #############################################################################
 //                           Platform Constants
 // #############################################################################
-constexpr int TRANSIENT_STORAGE_SIZE = MB(128);
+// Reserved up front, F10 in game reports the high water marks to size these
+constexpr int TRANSIENT_STORAGE_SIZE = MB(50);
 constexpr int PERSISTENT_STORAGE_SIZE = MB(256);
 
+// Where SM_PERSISTENT_FILE gets mapped, far away from Heap, Stacks and Libraries
+constexpr size_t PERSISTENT_BASE_ADDRESS = 0x100000000000;
+constexpr int PERSISTENT_LAYOUT_VERSION = 1;
+
 // #############################################################################
 //                           Platform Globals
 // #############################################################################
 static bool running = true;
 static KeyCodeID KeyCodeLookupTable[MAX_KEYCODES];
-static BumpAllocator transientStorage;
-static BumpAllocator persistentStorage;
 static float musicVolume = 0.25f;
 
 // #############################################################################
@@ -29,6 +32,10 @@ void platform_set_vsync(bool vSync);
 void* platform_load_dynamic_library(const char* dll);
 void* platform_load_dynamic_function(void* dll, const char* funName);
 bool platform_free_dynamic_library(void* dll);
+bool platform_copy_file(const char* fileName, const char* outputName);
+bool platform_write_file_atomic(const char* fileName, char* buffer, int size);
+typedef void (*PlatformThreadProc)(void* data);
+bool platform_create_thread(PlatformThreadProc threadProc, void* data);
 bool platform_init_audio();
 void platform_update_audio(float dt);
 void platform_sleep(unsigned int ms);
\ No newline at end of file
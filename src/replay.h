@@ -0,0 +1,521 @@
+#pragma once
+#include "game.h"
+
+// Replays are Level Files with their own Chunks
+#include "level_file.h"
+
+// #############################################################################
+//                           Replay Constants
+// #############################################################################
+// A Replay is the full GameState it started from plus the sampled GameInput
+// of every Tick, see sample_game_input(). The Update runs at a fixed
+// UPDATE_DELAY, so playing it back ends up in the same GameState every time.
+// A Tick whose Input didn't change costs one Bit, otherwise one Bit plus
+// isDown and justPressed of every GameInput
+static constexpr int MAX_REPLAY_PATH = 64;
+static constexpr int REPLAY_INPUT_BITS = 2 * GAME_INPUT_COUNT;
+static constexpr int MAX_REPLAY_INPUT_SIZE = MB(1);
+
+// Seeking restores the last Keyframe before the Tick and plays the Input
+// from there, so it never simulates more than REPLAY_KEYFRAME_SECONDS
+static constexpr int REPLAY_KEYFRAME_SECONDS = 5;
+static constexpr int REPLAY_KEYFRAME_INTERVAL = REPLAY_KEYFRAME_SECONDS * UPDATES_PER_SECOND;
+static constexpr int MAX_REPLAY_KEYFRAMES = 1024; // 85 Minutes
+static constexpr int MAX_REPLAY_KEYFRAME_DATA = MB(16);
+
+enum ReplayMode
+{
+  REPLAY_MODE_OFF,
+  REPLAY_MODE_RECORDING,
+  REPLAY_MODE_PLAYBACK,
+};
+
+// #############################################################################
+//                           Replay Structs
+// #############################################################################
+// Where Playback picks up after restoring the Keyframe
+struct ReplayKeyframe
+{
+  int tick;
+  int bitIdx;
+  unsigned int lastInput;
+
+  // RLE GameState, into keyframeData while recording, into the File when playing
+  int offset;
+  int size;
+};
+
+struct ReplayState
+{
+  ReplayMode mode;
+  char path[MAX_REPLAY_PATH];
+
+  // Set by the Platform, picked up at the start of the next Frame
+  ReplayMode requestedMode;
+  char requestedPath[MAX_REPLAY_PATH];
+
+  // Set when a Playback ends, Headless Runs quit on it
+  bool finished;
+  bool failed;
+
+  int tickCount;
+  int tick;
+  int bitCount;
+  int bitIdx;
+  unsigned int lastInput;
+  long long startUs;
+
+  // Set like requestedMode, Seeks run before the Ticks of the Frame
+  bool seekRequested;
+  int seekTick;
+  int seekSimulatedTicks;
+  double seekMs;
+
+  // Set while seek_replay() simulates, no Rewind Frames get recorded
+  bool seeking;
+
+  // The Replay File while playing, mapped where the Platform can
+  char* file;
+  int fileSize;
+  bool fileMapped;
+
+  GameState startState;
+  int keyframeCount;
+  ReplayKeyframe keyframes[MAX_REPLAY_KEYFRAMES];
+  int keyframeDataSize;
+  unsigned char bits[MAX_REPLAY_INPUT_SIZE];
+
+  // Recorded Keyframes, also holds the File where it can't be mapped
+  char keyframeData[MAX_REPLAY_KEYFRAME_DATA];
+};
+
+// #############################################################################
+//                           Replay Globals
+// #############################################################################
+static ReplayState* replayState;
+
+// #############################################################################
+//                           Replay Functions
+// #############################################################################
+void request_replay(ReplayMode mode, char* path)
+{
+  SM_ASSERT(strlen(path) < MAX_REPLAY_PATH, "Replay Path too long: %s", path);
+  strcpy(replayState->requestedPath, path);
+  replayState->requestedMode = mode;
+}
+
+void request_replay_seek(int tick)
+{
+  replayState->seekTick = tick;
+  replayState->seekRequested = true;
+}
+
+bool replay_write_bits(unsigned int value, int bitCount)
+{
+  if(replayState->bitIdx + bitCount > MAX_REPLAY_INPUT_SIZE * 8)
+  {
+    return false;
+  }
+
+  for(int bit = 0; bit < bitCount; bit++)
+  {
+    int bitIdx = replayState->bitIdx++;
+    if(value & (1u << bit))
+    {
+      replayState->bits[bitIdx / 8] |= (unsigned char)(1 << (bitIdx % 8));
+    }
+    else
+    {
+      replayState->bits[bitIdx / 8] &= (unsigned char)~(1 << (bitIdx % 8));
+    }
+  }
+  return true;
+}
+
+unsigned int replay_read_bits(int bitCount)
+{
+  unsigned int value = 0;
+  for(int bit = 0; bit < bitCount; bit++)
+  {
+    int bitIdx = replayState->bitIdx++;
+    if(replayState->bits[bitIdx / 8] & (1 << (bitIdx % 8)))
+    {
+      value |= 1u << bit;
+    }
+  }
+  return value;
+}
+
+unsigned int pack_game_input(GameInput* gameInput)
+{
+  unsigned int packed = 0;
+  for(int inputIdx = 0; inputIdx < GAME_INPUT_COUNT; inputIdx++)
+  {
+    packed |= (gameInput[inputIdx].isDown? 1u : 0u) << (inputIdx * 2);
+    packed |= (gameInput[inputIdx].justPressed? 1u : 0u) << (inputIdx * 2 + 1);
+  }
+  return packed;
+}
+
+void unpack_game_input(unsigned int packed, GameInput* gameInput)
+{
+  for(int inputIdx = 0; inputIdx < GAME_INPUT_COUNT; inputIdx++)
+  {
+    gameInput[inputIdx].isDown = (packed >> (inputIdx * 2)) & 1;
+    gameInput[inputIdx].justPressed = (packed >> (inputIdx * 2 + 1)) & 1;
+  }
+}
+
+// The GameState before the Update that records the Tick changed anything
+void replay_record_keyframe(GameState* state)
+{
+  if(replayState->keyframeCount == MAX_REPLAY_KEYFRAMES ||
+     replayState->keyframeDataSize + rle_max_encoded_size(sizeof(GameState)) > 
+     MAX_REPLAY_KEYFRAME_DATA)
+  {
+    SM_WARN("Replay Keyframes full, Seeks past Tick %d simulate from there", 
+            replayState->tickCount);
+    return;
+  }
+
+  ReplayKeyframe* keyframe = &replayState->keyframes[replayState->keyframeCount++];
+  keyframe->tick = replayState->tickCount;
+  keyframe->bitIdx = replayState->bitIdx;
+  keyframe->lastInput = replayState->lastInput;
+  keyframe->offset = replayState->keyframeDataSize;
+  keyframe->size = rle_encode((unsigned char*)state, sizeof(GameState),
+                              (unsigned char*)replayState->keyframeData + keyframe->offset);
+  replayState->keyframeDataSize += keyframe->size;
+}
+
+// Runs at the Top of update(), before anything touches the GameState.
+// Updates that return before the Input, like Camera Transitions, see the
+// same Tick again, only the first one records its Keyframe
+void replay_update_keyframe(GameState* state)
+{
+  int tick = replayState->tickCount;
+  ReplayKeyframe* last = replayState->keyframeCount?
+                         &replayState->keyframes[replayState->keyframeCount - 1] : nullptr;
+  if(tick && tick % REPLAY_KEYFRAME_INTERVAL == 0 && (!last || last->tick < tick))
+  {
+    replay_record_keyframe(state);
+  }
+}
+
+// Returns false once the Buffer is full
+bool replay_record_tick(GameInput* gameInput)
+{
+  unsigned int packed = pack_game_input(gameInput);
+  bool unchanged = replayState->tickCount && packed == replayState->lastInput;
+  bool written = unchanged? replay_write_bits(1, 1) :
+                            replay_write_bits(packed << 1, 1 + REPLAY_INPUT_BITS);
+  if(written)
+  {
+    replayState->lastInput = packed;
+    replayState->tickCount++;
+  }
+  return written;
+}
+
+// Returns false once every Tick was played
+bool replay_play_tick(GameInput* gameInput)
+{
+  if(replayState->tick >= replayState->tickCount ||
+     replayState->bitIdx >= replayState->bitCount)
+  {
+    return false;
+  }
+
+  if(!replay_read_bits(1))
+  {
+    if(replayState->bitIdx + REPLAY_INPUT_BITS > replayState->bitCount)
+    {
+      return false;
+    }
+    replayState->lastInput = replay_read_bits(REPLAY_INPUT_BITS);
+  }
+  unpack_game_input(replayState->lastInput, gameInput);
+  replayState->tick++;
+  return true;
+}
+
+void start_replay_recording(char* path, GameState* state)
+{
+  strcpy(replayState->path, path);
+  replayState->startState = *state;
+  replayState->tickCount = 0;
+  replayState->bitIdx = 0;
+  replayState->lastInput = 0;
+  replayState->keyframeCount = 0;
+  replayState->keyframeDataSize = 0;
+  replayState->startUs = get_time_us();
+  replayState->mode = REPLAY_MODE_RECORDING;
+  SM_TRACE("Recording Replay: %s", path);
+}
+
+bool stop_replay_recording(BumpAllocator* transientStorage)
+{
+  replayState->mode = REPLAY_MODE_OFF;
+
+  TempArena temp(transientStorage);
+  int byteCount = (replayState->bitIdx + 7) / 8;
+  int indexSize = replayState->keyframeCount * (int)sizeof(ReplayKeyframe);
+  int capacity = MAX_LEVEL_FILE_SIZE + byteCount + replayState->keyframeDataSize + indexSize;
+  char* buffer = bump_alloc(transientStorage, capacity, ALLOC_TAG_GAME);
+  if(!buffer)
+  {
+    SM_ERROR("Failed to allocate the Replay File: %s", replayState->path);
+    return false;
+  }
+
+  LevelWriter writer = {buffer, capacity};
+  level_write_header(&writer);
+  level_begin_chunk(&writer, LEVEL_CHUNK_REPLAY_STATE);
+  level_write_int(&writer, sizeof(GameState));
+  level_write_rle(&writer, (unsigned char*)&replayState->startState, sizeof(GameState));
+  level_end_chunk(&writer);
+
+  level_begin_chunk(&writer, LEVEL_CHUNK_REPLAY_INPUT);
+  level_write_int(&writer, replayState->tickCount);
+  level_write_int(&writer, replayState->bitIdx);
+  level_write(&writer, replayState->bits, byteCount);
+  level_end_chunk(&writer);
+
+  level_begin_chunk(&writer, LEVEL_CHUNK_REPLAY_KEYFRAMES);
+  int keyframesStart = writer.used;
+  level_write(&writer, replayState->keyframeData, replayState->keyframeDataSize);
+  level_end_chunk(&writer);
+
+  // Offsets from the Start of the File, so Readers can map it and seek right away
+  level_begin_chunk(&writer, LEVEL_CHUNK_REPLAY_INDEX);
+  level_write_int(&writer, replayState->keyframeCount);
+  for(int keyframeIdx = 0; keyframeIdx < replayState->keyframeCount; keyframeIdx++)
+  {
+    ReplayKeyframe* keyframe = &replayState->keyframes[keyframeIdx];
+    level_write_int(&writer, keyframe->tick);
+    level_write_int(&writer, keyframe->bitIdx);
+    level_write_int(&writer, (int)keyframe->lastInput);
+    level_write_int(&writer, keyframesStart + keyframe->offset);
+    level_write_int(&writer, keyframe->size);
+  }
+  level_end_chunk(&writer);
+  level_finish(&writer);
+
+  if(writer.overflow)
+  {
+    SM_ERROR("Failed encoding Replay: %s", replayState->path);
+    return false;
+  }
+
+  write_file(replayState->path, buffer, writer.used);
+  SM_TRACE("Recorded Replay %s: %d Ticks, %d Bytes of Input, %d Keyframes, %d Bytes total",
+           replayState->path, replayState->tickCount, byteCount, replayState->keyframeCount,
+           writer.used);
+  return true;
+}
+
+void replay_close_file()
+{
+  if(replayState->fileMapped)
+  {
+    unmap_file(replayState->file, replayState->fileSize);
+  }
+  replayState->file = nullptr;
+  replayState->fileSize = 0;
+  replayState->fileMapped = false;
+  replayState->keyframeCount = 0;
+}
+
+// Every Keyframe has to lie inside the File and come after the one before
+bool replay_validate_keyframes()
+{
+  int prevTick = 0;
+  for(int keyframeIdx = 0; keyframeIdx < replayState->keyframeCount; keyframeIdx++)
+  {
+    ReplayKeyframe* keyframe = &replayState->keyframes[keyframeIdx];
+    if(keyframe->tick <= prevTick || keyframe->tick > replayState->tickCount ||
+       keyframe->bitIdx < 0 || keyframe->bitIdx > replayState->bitCount ||
+       keyframe->offset < 0 || keyframe->size <= 0 ||
+       keyframe->offset > replayState->fileSize - keyframe->size)
+    {
+      return false;
+    }
+    prevTick = keyframe->tick;
+  }
+  return true;
+}
+
+// Replaces the GameState with the one the Replay started from
+bool start_replay_playback(char* path, GameState* state)
+{
+  replay_close_file();
+  replayState->mode = REPLAY_MODE_OFF;
+  replayState->finished = false;
+  replayState->failed = false;
+  replayState->seekSimulatedTicks = 0;
+  replayState->seekMs = 0.0;
+
+  // Keyframes are decoded straight out of the File, it stays around while playing
+  int fileSize = 0;
+  char* data = map_file(path, &fileSize);
+  replayState->fileMapped = data != nullptr;
+  if(!data)
+  {
+    long size = get_file_size(path);
+    if(size > 0 && size < MAX_REPLAY_KEYFRAME_DATA)
+    {
+      data = read_file(path, &fileSize, replayState->keyframeData);
+    }
+  }
+  replayState->file = data;
+  replayState->fileSize = fileSize;
+
+  bool hasState = false;
+  bool hasInput = false;
+  bool decoded = data && decode_level_file(data, fileSize, [&](LevelReader* reader, LevelChunkID id)
+  {
+    switch(id)
+    {
+      case LEVEL_CHUNK_REPLAY_STATE:
+      {
+        if(level_read_int(reader) != sizeof(GameState))
+        {
+          SM_WARN("GameState changed since the Replay was recorded");
+          return false;
+        }
+        hasState = level_read_rle(reader, (unsigned char*)&replayState->startState,
+                                  sizeof(GameState));
+        return hasState;
+      }
+
+      case LEVEL_CHUNK_REPLAY_INPUT:
+      {
+        int tickCount = level_read_int(reader);
+        int bitCount = level_read_int(reader);
+        int byteCount = (bitCount + 7) / 8;
+        if(tickCount < 0 || bitCount < 0 || byteCount > MAX_REPLAY_INPUT_SIZE ||
+           bitCount < tickCount || bitCount > tickCount * (1 + REPLAY_INPUT_BITS))
+        {
+          return false;
+        }
+
+        replayState->tickCount = tickCount;
+        replayState->bitCount = bitCount;
+        hasInput = level_read(reader, replayState->bits, byteCount) != nullptr;
+        return hasInput;
+      }
+
+      // Only read through the Index
+      case LEVEL_CHUNK_REPLAY_KEYFRAMES:
+      {
+        return true;
+      }
+
+      case LEVEL_CHUNK_REPLAY_INDEX:
+      {
+        int keyframeCount = level_read_int(reader);
+        if(keyframeCount < 0 || keyframeCount > MAX_REPLAY_KEYFRAMES)
+        {
+          return false;
+        }
+
+        replayState->keyframeCount = keyframeCount;
+        for(int keyframeIdx = 0; keyframeIdx < keyframeCount; keyframeIdx++)
+        {
+          ReplayKeyframe* keyframe = &replayState->keyframes[keyframeIdx];
+          keyframe->tick = level_read_int(reader);
+          keyframe->bitIdx = level_read_int(reader);
+          keyframe->lastInput = (unsigned int)level_read_int(reader);
+          keyframe->offset = level_read_int(reader);
+          keyframe->size = level_read_int(reader);
+        }
+        return !reader->overflow;
+      }
+
+      // Chunks a Replay doesn't use are skipped
+      default:
+      {
+        break;
+      }
+    }
+
+    return true;
+  });
+
+  // Replays without an Index still play, they just seek from the Start
+  if(!decoded || !hasState || !hasInput || !replay_validate_keyframes())
+  {
+    SM_ERROR("Failed loading Replay: %s", path);
+    replay_close_file();
+    replayState->finished = true;
+    replayState->failed = true;
+    return false;
+  }
+
+  *state = replayState->startState;
+  strcpy(replayState->path, path);
+  replayState->tick = 0;
+  replayState->bitIdx = 0;
+  replayState->startUs = get_time_us();
+  replayState->mode = REPLAY_MODE_PLAYBACK;
+  SM_TRACE("Playing Replay %s: %d Ticks, %d Keyframes", path, replayState->tickCount,
+           replayState->keyframeCount);
+  return true;
+}
+
+void stop_replay_playback()
+{
+  replay_close_file();
+  replayState->mode = REPLAY_MODE_OFF;
+  replayState->finished = true;
+  SM_TRACE("Played Replay %s: %d Ticks in %.2f ms", replayState->path, replayState->tick,
+           (get_time_us() - replayState->startUs) / 1000.0);
+}
+
+// Restores the last Keyframe at or before tick and returns its Tick,
+// the Caller plays the Ticks after it. The updateTimer is kept, it
+// belongs to the Frame, not to the Replay
+int replay_restore_keyframe(GameState* state, int tick)
+{
+  // Keyframes are sorted by Tick, find the first one after it
+  int low = 0;
+  int high = replayState->keyframeCount;
+  while(low < high)
+  {
+    int mid = (low + high) / 2;
+    if(replayState->keyframes[mid].tick <= tick)
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+
+  double updateTimer = state->updateTimer;
+  ReplayKeyframe* keyframe = low? &replayState->keyframes[low - 1] : nullptr;
+  if(keyframe && !rle_decode((unsigned char*)replayState->file + keyframe->offset,
+                             keyframe->size, (unsigned char*)state, sizeof(GameState)))
+  {
+    SM_WARN("Corrupt Replay Keyframe at Tick %d, seeking from the Start", keyframe->tick);
+    keyframe = nullptr;
+  }
+
+  if(keyframe)
+  {
+    replayState->tick = keyframe->tick;
+    replayState->bitIdx = keyframe->bitIdx;
+    replayState->lastInput = keyframe->lastInput;
+  }
+  else
+  {
+    *state = replayState->startState;
+    replayState->tick = 0;
+    replayState->bitIdx = 0;
+    replayState->lastInput = 0;
+  }
+  state->updateTimer = updateTimer;
+
+  return replayState->tick;
+}
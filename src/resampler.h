@@ -0,0 +1,343 @@
+#pragma once
+#include "schnitzel_lib.h"
+
+// Used to time the Resampler Benchmark
+#include <chrono>
+
+#ifdef __SSE2__
+#include <immintrin.h> // SSE2 / AVX2 filtering
+#endif
+
+// #############################################################################
+//                           Resampler Constants
+// #############################################################################
+// Taps per Phase, multiple of 8 for the AVX2 path
+static constexpr int RESAMPLER_TAPS = 32;
+
+// Rate pairs that would need more Phases than this, e.g. 44056 -> 44100,
+// snap to the nearest Phase instead
+static constexpr int RESAMPLER_MAX_PHASES = 512;
+
+// Cutoff relative to the lower Nyquist frequency, leaves room for the
+// transition band of the window so we don't alias when downsampling
+static constexpr float RESAMPLER_CUTOFF = 0.9f;
+
+// #############################################################################
+//                           Resampler Structs
+// #############################################################################
+// Polyphase windowed-sinc, outRate / inRate = upFactor / downFactor
+struct Resampler
+{
+  int upFactor;
+  int downFactor;
+  int phaseCount;
+
+  // phaseCount * RESAMPLER_TAPS, Phase p starts at filters[p * RESAMPLER_TAPS]
+  float* filters;
+};
+
+// #############################################################################
+//                           Resampler Functions
+// #############################################################################
+int greatest_common_divisor(int a, int b)
+{
+  while(b)
+  {
+    int t = a % b;
+    a = b;
+    b = t;
+  }
+
+  return a;
+}
+
+Resampler make_resampler(int inRate, int outRate, BumpAllocator* bumpAllocator)
+{
+  SM_ASSERT(inRate > 0 && outRate > 0, "Invalid Sample Rates: %d -> %d", inRate, outRate);
+
+  Resampler resampler = {};
+  int divisor = greatest_common_divisor(inRate, outRate);
+  resampler.upFactor = outRate / divisor;
+  resampler.downFactor = inRate / divisor;
+  resampler.phaseCount = min(resampler.upFactor, RESAMPLER_MAX_PHASES);
+  resampler.filters = (float*)bump_alloc(bumpAllocator,
+                                         resampler.phaseCount * RESAMPLER_TAPS * sizeof(float),
+                                         ALLOC_TAG_SOUND);
+  if(!resampler.filters)
+  {
+    return {};
+  }
+
+  // Normalized to the input rate, 0.5 is the input Nyquist frequency
+  float cutoff = 0.5f * RESAMPLER_CUTOFF * min(1.0f, (float)outRate / (float)inRate);
+  for(int phase = 0; phase < resampler.phaseCount; phase++)
+  {
+    float* filter = &resampler.filters[phase * RESAMPLER_TAPS];
+    float frac = (float)phase / (float)resampler.phaseCount;
+    float sum = 0.0f;
+
+    // Tap k reads input sample (idx - RESAMPLER_TAPS / 2 + 1 + k)
+    for(int k = 0; k < RESAMPLER_TAPS; k++)
+    {
+      float t = (float)(k - RESAMPLER_TAPS / 2 + 1) - frac;
+      float x = 2.0f * cutoff * t;
+      float sinc = fabsf(x) < 0.000001f? 1.0f : sinf(PI * x) / (PI * x);
+
+      // Blackman window over the span of the filter
+      float w = (t + RESAMPLER_TAPS / 2) / RESAMPLER_TAPS;
+      float window = 0.42f - 0.5f * cosf(2.0f * PI * w) + 0.08f * cosf(4.0f * PI * w);
+
+      filter[k] = sinc * window;
+      sum += filter[k];
+    }
+
+    // Unity gain at DC for every Phase
+    for(int k = 0; k < RESAMPLER_TAPS; k++)
+    {
+      filter[k] /= sum;
+    }
+  }
+
+  return resampler;
+}
+
+int resampled_frame_count(Resampler* resampler, int inFrames)
+{
+  long long up = resampler->upFactor;
+  long long down = resampler->downFactor;
+  return (int)((inFrames * up + down - 1) / down);
+}
+
+float resampler_dot(float* filter, float* src)
+{
+#if defined(__AVX2__)
+  __m256 sum = _mm256_setzero_ps();
+  for(int k = 0; k < RESAMPLER_TAPS; k += 8)
+  {
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(filter + k), _mm256_loadu_ps(src + k)));
+  }
+  __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+#elif defined(__SSE2__)
+  __m128 sum4 = _mm_setzero_ps();
+  for(int k = 0; k < RESAMPLER_TAPS; k += 4)
+  {
+    sum4 = _mm_add_ps(sum4, _mm_mul_ps(_mm_loadu_ps(filter + k), _mm_loadu_ps(src + k)));
+  }
+#endif
+
+#ifdef __SSE2__
+  // Horizontal add
+  sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+  sum4 = _mm_add_ss(sum4, _mm_shuffle_ps(sum4, sum4, 1));
+  return _mm_cvtss_f32(sum4);
+#else
+  float sum = 0.0f;
+  for(int k = 0; k < RESAMPLER_TAPS; k++)
+  {
+    sum += filter[k] * src[k];
+  }
+  return sum;
+#endif
+}
+
+// src needs RESAMPLER_TAPS readable (zero) samples before and after inFrames
+void resample_channel(Resampler* resampler, float* src, int inFrames, float* dst, int outFrames)
+{
+  long long up = resampler->upFactor;
+  long long down = resampler->downFactor;
+  for(int frameIdx = 0; frameIdx < outFrames; frameIdx++)
+  {
+    long long pos = frameIdx * down;
+    long long idx = pos / up;
+    long long phase = (pos % up) * resampler->phaseCount / up;
+    SM_ASSERT(idx < inFrames, "Resampler read out of Bounds: %lld", idx);
+
+    float* filter = &resampler->filters[phase * RESAMPLER_TAPS];
+    dst[frameIdx] = resampler_dot(filter, src + idx - RESAMPLER_TAPS / 2 + 1);
+  }
+}
+
+// #############################################################################
+//                           Format Conversion
+// #############################################################################
+bool wav_is_native_format(WAVHeader* header)
+{
+  return header->audioFormat == WAVE_FORMAT_PCM &&
+         header->numChannels == NUM_CHANNELS &&
+         header->sampleRate == SAMPLE_RATE &&
+         header->bitsPerSample == 16;
+}
+
+bool wav_can_convert(WAVHeader* header)
+{
+  if(header->audioFormat == WAVE_FORMAT_IEEE_FLOAT)
+  {
+    return header->bitsPerSample == 32;
+  }
+
+  return header->audioFormat == WAVE_FORMAT_PCM &&
+         (header->bitsPerSample == 8  || header->bitsPerSample == 16 ||
+          header->bitsPerSample == 24 || header->bitsPerSample == 32);
+}
+
+// Reads one Channel of interleaved Samples as float in [-1, 1]
+void wav_decode_channel(WAVHeader* header, char* data, int channel, float* dst, int frameCount)
+{
+  int bytesPerSample = header->bitsPerSample / 8;
+  int stride = header->blockAlign;
+  unsigned char* src = (unsigned char*)data + channel * bytesPerSample;
+
+  for(int frameIdx = 0; frameIdx < frameCount; frameIdx++, src += stride)
+  {
+    float sample = 0.0f;
+    if(header->audioFormat == WAVE_FORMAT_IEEE_FLOAT)
+    {
+      memcpy(&sample, src, sizeof(float));
+    }
+    else switch(header->bitsPerSample)
+    {
+      // 8 Bit WAV is unsigned
+      case 8:  sample = (src[0] - 128) / 128.0f; break;
+      case 16: sample = (short)(src[0] | src[1] << 8) / 32768.0f; break;
+      case 24: sample = (int)(src[0] << 8 | src[1] << 16 | src[2] << 24) / 2147483648.0f; break;
+      case 32: sample = (int)(src[0] | src[1] << 8 | src[2] << 16 | src[3] << 24) / 2147483648.0f; break;
+    }
+
+    dst[frameIdx] = sample;
+  }
+}
+
+// Interleaves two Channels into Stereo int16, clamps anything out of range
+void float_to_pcm16(float* left, float* right, short* dst, int frameCount)
+{
+  int frameIdx = 0;
+
+#ifdef __SSE2__
+  __m128 scale = _mm_set1_ps(32767.0f);
+  for(; frameIdx + 4 <= frameCount; frameIdx += 4)
+  {
+    __m128i l = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(left + frameIdx), scale));
+    __m128i r = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(right + frameIdx), scale));
+
+    // Saturates to int16, then L0 R0 L1 R1 L2 R2 L3 R3
+    __m128i interleaved = _mm_unpacklo_epi16(_mm_packs_epi32(l, l), _mm_packs_epi32(r, r));
+    _mm_storeu_si128((__m128i*)(dst + frameIdx * NUM_CHANNELS), interleaved);
+  }
+#endif
+
+  for(; frameIdx < frameCount; frameIdx++)
+  {
+    float l = clamp(left[frameIdx] * 32767.0f, -32768.0f, 32767.0f);
+    float r = clamp(right[frameIdx] * 32767.0f, -32768.0f, 32767.0f);
+    dst[frameIdx * NUM_CHANNELS + 0] = (short)roundf(l);
+    dst[frameIdx * NUM_CHANNELS + 1] = (short)roundf(r);
+  }
+}
+
+int converted_frame_count(WAVHeader* header)
+{
+  int inFrames = header->dataChunkSize / header->blockAlign;
+  long long outFrames = (long long)inFrames * SAMPLE_RATE;
+  return (int)((outFrames + header->sampleRate - 1) / header->sampleRate);
+}
+
+// Converts any supported WAV data into 44100 Hz Stereo int16, dst needs room
+// for converted_frame_count() Frames. Scratch memory comes from bumpAllocator
+bool convert_wav(WAVHeader* header, char* data, short* dst, BumpAllocator* bumpAllocator)
+{
+  SM_ASSERT(wav_can_convert(header), "Unsupported WAV Format: %d, %d Bits",
+            header->audioFormat, header->bitsPerSample);
+
+  int inFrames = header->dataChunkSize / header->blockAlign;
+  int outFrames = converted_frame_count(header);
+  Resampler resampler = make_resampler(header->sampleRate, SAMPLE_RATE, bumpAllocator);
+  if(!resampler.filters)
+  {
+    return false;
+  }
+  SM_ASSERT(resampled_frame_count(&resampler, inFrames) == outFrames, "Frame Count mismatch");
+
+  // Mono is resampled once and played on both Channels, anything
+  // beyond Stereo is dropped
+  int channelCount = min((int)header->numChannels, NUM_CHANNELS);
+  float* channels[NUM_CHANNELS] = {};
+  for(int channel = 0; channel < channelCount; channel++)
+  {
+    // Zero padding on both sides for the filter taps
+    int paddedFrames = inFrames + 2 * RESAMPLER_TAPS;
+    float* src = (float*)bump_alloc(bumpAllocator, paddedFrames * sizeof(float), ALLOC_TAG_SOUND);
+    float* resampled = (float*)bump_alloc(bumpAllocator, outFrames * sizeof(float), ALLOC_TAG_SOUND);
+    if(!src || !resampled)
+    {
+      return false;
+    }
+
+    memset(src, 0, paddedFrames * sizeof(float));
+    wav_decode_channel(header, data, channel, src + RESAMPLER_TAPS, inFrames);
+
+    if(resampler.upFactor == resampler.downFactor)
+    {
+      channels[channel] = src + RESAMPLER_TAPS;
+    }
+    else
+    {
+      resample_channel(&resampler, src + RESAMPLER_TAPS, inFrames, resampled, outFrames);
+      channels[channel] = resampled;
+    }
+  }
+
+  float_to_pcm16(channels[0], channels[channelCount - 1], dst, outFrames);
+  return true;
+}
+
+// #############################################################################
+//                           Resampler Benchmark
+// #############################################################################
+char* resampler_path_name()
+{
+#if defined(__AVX2__)
+  return "AVX2";
+#elif defined(__SSE2__)
+  return "SSE2";
+#else
+  return "Scalar";
+#endif
+}
+
+// Resamples 10s of noise for the common Rate pairs and logs the throughput
+void bench_resampler(BumpAllocator* bumpAllocator)
+{
+  int rates[][2] = {{48000, 44100}, {22050, 44100}, {32000, 44100}, {44100, 48000}};
+  for(int rateIdx = 0; rateIdx < (int)ArraySize(rates); rateIdx++)
+  {
+    TempArena temp(bumpAllocator);
+
+    int inRate = rates[rateIdx][0];
+    int outRate = rates[rateIdx][1];
+    int inFrames = inRate * 10;
+    Resampler resampler = make_resampler(inRate, outRate, bumpAllocator);
+    int outFrames = resampled_frame_count(&resampler, inFrames);
+    float* src = (float*)bump_alloc(bumpAllocator, (inFrames + 2 * RESAMPLER_TAPS) * sizeof(float),
+                                      ALLOC_TAG_SOUND);
+    float* dst = (float*)bump_alloc(bumpAllocator, outFrames * sizeof(float), ALLOC_TAG_SOUND);
+    if(!resampler.filters || !src || !dst)
+    {
+      return;
+    }
+
+    memset(src, 0, (inFrames + 2 * RESAMPLER_TAPS) * sizeof(float));
+    for(int frameIdx = 0; frameIdx < inFrames; frameIdx++)
+    {
+      src[RESAMPLER_TAPS + frameIdx] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    resample_channel(&resampler, src + RESAMPLER_TAPS, inFrames, dst, outFrames);
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    SM_TRACE("Resampler (%s): %d -> %d Hz, %d Phases, %.1f MSamples/s",
+             resampler_path_name(), inRate, outRate, resampler.phaseCount,
+             outFrames / seconds / 1000000.0);
+  }
+}
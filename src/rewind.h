@@ -0,0 +1,356 @@
+#pragma once
+#include "game.h"
+
+// Keyframes reuse the Level File's Run Length Encoding
+#include "level_file.h"
+
+// #############################################################################
+//                           Rewind Constants
+// #############################################################################
+// Every Tick gets recorded, a Keyframe once a Second and Deltas against it
+// in between, so restoring any Tick is one Keyframe plus one Delta
+static constexpr int REWIND_SECONDS = 30;
+static constexpr int REWIND_MAX_FRAMES = REWIND_SECONDS * UPDATES_PER_SECOND;
+static constexpr int REWIND_KEYFRAME_INTERVAL = UPDATES_PER_SECOND;
+
+// The oldest Second gets dropped when either runs out
+static constexpr int REWIND_BUFFER_SIZE = MB(4);
+
+// A Delta this big is no cheaper than a Keyframe
+static constexpr int REWIND_MAX_DELTA_SIZE = sizeof(GameState) / 4;
+
+// Dropping the oldest Second has to make room, the Second being recorded stays
+static_assert(REWIND_MAX_DELTA_SIZE * REWIND_KEYFRAME_INTERVAL + 2 * sizeof(GameState) <=
+              REWIND_BUFFER_SIZE, "REWIND_BUFFER_SIZE can't hold a Keyframe Interval");
+
+// Deltas work on 8 Byte Words, the Tail is compared Byte by Byte
+static constexpr int REWIND_WORD_COUNT = sizeof(GameState) / sizeof(unsigned long long);
+
+// #############################################################################
+//                           Rewind Structs
+// #############################################################################
+struct RewindFrame
+{
+  int offset;
+  int size;
+
+  // Frame Index of the Keyframe this Delta is against, its own for Keyframes
+  int keyframe;
+};
+
+struct RewindState
+{
+  // Frame Indices count up from the first recorded Tick,
+  // Frame n lives in frames[n % REWIND_MAX_FRAMES]
+  int firstFrame;
+  int frameCount;
+  bool needsKeyframe;
+
+  // Encoded Frames, oldest first, wrapping around to the Start
+  int writeOffset;
+  RewindFrame frames[REWIND_MAX_FRAMES];
+  char data[REWIND_BUFFER_SIZE];
+
+  // What Deltas are taken against
+  GameState keyframe;
+
+  // Stats
+  double recordMs;
+  double restoreMs;
+};
+
+// #############################################################################
+//                           Rewind Globals
+// #############################################################################
+static RewindState* rewindState;
+
+// #############################################################################
+//                           Rewind Functions
+// #############################################################################
+RewindFrame* get_rewind_frame(int frameIdx)
+{
+  return &rewindState->frames[frameIdx % REWIND_MAX_FRAMES];
+}
+
+int rewind_frame_count()
+{
+  return rewindState->frameCount;
+}
+
+int rewind_used_bytes()
+{
+  if(!rewindState->frameCount)
+  {
+    return 0;
+  }
+
+  int start = get_rewind_frame(rewindState->firstFrame)->offset;
+  int end = rewindState->writeOffset;
+  return end > start? end - start : REWIND_BUFFER_SIZE - start + end;
+}
+
+// Runs of changed Words: skipped Words, changed Words, then the changed
+// Words XORed with the Keyframe. Returns the Size, 0 if it got too big
+int rewind_encode_delta(char* base, char* current, char* dst, int capacity)
+{
+  int used = 0;
+  int wordIdx = 0;
+  while(true)
+  {
+    int runStart = wordIdx;
+    while(wordIdx < REWIND_WORD_COUNT &&
+          !memcmp(base + wordIdx * 8, current + wordIdx * 8, 8))
+    {
+      wordIdx++;
+    }
+    if(wordIdx == REWIND_WORD_COUNT)
+    {
+      break;
+    }
+
+    // A single unchanged Word costs less than a new Run Header
+    int changedStart = wordIdx;
+    while(wordIdx < REWIND_WORD_COUNT &&
+          (memcmp(base + wordIdx * 8, current + wordIdx * 8, 8) ||
+           (wordIdx + 1 < REWIND_WORD_COUNT &&
+            memcmp(base + wordIdx * 8 + 8, current + wordIdx * 8 + 8, 8))))
+    {
+      wordIdx++;
+    }
+
+    int run[2] = {changedStart - runStart, wordIdx - changedStart};
+    if(used + (int)sizeof(run) + run[1] * 8 > capacity)
+    {
+      return 0;
+    }
+    memcpy(dst + used, run, sizeof(run));
+    used += sizeof(run);
+
+    for(int changedIdx = changedStart; changedIdx < wordIdx; changedIdx++)
+    {
+      unsigned long long baseWord, word;
+      memcpy(&baseWord, base + changedIdx * 8, 8);
+      memcpy(&word, current + changedIdx * 8, 8);
+      word ^= baseWord;
+      memcpy(dst + used, &word, 8);
+      used += 8;
+    }
+  }
+
+  // The Bytes that don't fill a Word are stored as they are
+  int tailSize = sizeof(GameState) - REWIND_WORD_COUNT * 8;
+  if(used + tailSize > capacity)
+  {
+    return 0;
+  }
+  memcpy(dst + used, current + REWIND_WORD_COUNT * 8, tailSize);
+  return used + tailSize;
+}
+
+void rewind_apply_delta(char* src, int size, char* state)
+{
+  int tailSize = sizeof(GameState) - REWIND_WORD_COUNT * 8;
+  char* end = src + size - tailSize;
+
+  int wordIdx = 0;
+  while(src < end)
+  {
+    int run[2];
+    memcpy(run, src, sizeof(run));
+    src += sizeof(run);
+
+    wordIdx += run[0];
+    for(int changedIdx = 0; changedIdx < run[1]; changedIdx++)
+    {
+      unsigned long long word, delta;
+      memcpy(&word, state + wordIdx * 8, 8);
+      memcpy(&delta, src, 8);
+      word ^= delta;
+      memcpy(state + wordIdx * 8, &word, 8);
+      src += 8;
+      wordIdx++;
+    }
+  }
+
+  memcpy(state + REWIND_WORD_COUNT * 8, end, tailSize);
+}
+
+// A Delta can't outlive its Keyframe, so whole Seconds get dropped
+void rewind_drop_oldest()
+{
+  do
+  {
+    rewindState->firstFrame++;
+    rewindState->frameCount--;
+  }
+  while(rewindState->frameCount &&
+        get_rewind_frame(rewindState->firstFrame)->keyframe != rewindState->firstFrame);
+}
+
+// Drops the oldest Frames until size Bytes fit behind the newest one
+int rewind_reserve(int size)
+{
+  int offset = rewindState->frameCount? rewindState->writeOffset : 0;
+  if(offset + size > REWIND_BUFFER_SIZE)
+  {
+    // Frames behind the newest one are older than the ones at the Start,
+    // they go first, then the Start gets freed up oldest first
+    while(rewindState->frameCount &&
+          get_rewind_frame(rewindState->firstFrame)->offset >= offset)
+    {
+      rewind_drop_oldest();
+    }
+    offset = 0;
+  }
+
+  while(rewindState->frameCount)
+  {
+    RewindFrame* oldest = get_rewind_frame(rewindState->firstFrame);
+    bool overlaps = oldest->offset < offset + size && offset < oldest->offset + oldest->size;
+    if(!overlaps && rewindState->frameCount < REWIND_MAX_FRAMES)
+    {
+      break;
+    }
+    rewind_drop_oldest();
+  }
+
+  return offset;
+}
+
+// Walks the Frames oldest first, each one has to start behind the one before,
+// or wrap around once and stay in front of the oldest
+bool rewind_check_frames()
+{
+  if(!rewindState->frameCount)
+  {
+    return true;
+  }
+
+  RewindFrame* oldest = get_rewind_frame(rewindState->firstFrame);
+  int end = oldest->offset + oldest->size;
+  bool wrapped = false;
+  for(int frameIdx = 1; frameIdx < rewindState->frameCount; frameIdx++)
+  {
+    RewindFrame* frame = get_rewind_frame(rewindState->firstFrame + frameIdx);
+    if(frame->offset < end)
+    {
+      if(wrapped || frame->offset < 0)
+      {
+        return false;
+      }
+      wrapped = true;
+    }
+
+    end = frame->offset + frame->size;
+    if(end > REWIND_BUFFER_SIZE || (wrapped && end > oldest->offset))
+    {
+      return false;
+    }
+  }
+
+  return end == rewindState->writeOffset;
+}
+
+void rewind_record(GameState* state, BumpAllocator* transientStorage)
+{
+  long long startUs = get_time_us();
+  TempArena temp(transientStorage);
+
+  int newFrame = rewindState->firstFrame + rewindState->frameCount;
+  int keyframe = rewindState->frameCount?
+                 get_rewind_frame(newFrame - 1)->keyframe : newFrame;
+  bool isKeyframe = !rewindState->frameCount || rewindState->needsKeyframe ||
+                    newFrame - keyframe >= REWIND_KEYFRAME_INTERVAL;
+
+  int size = 0;
+  char* encoded = 0;
+  if(!isKeyframe)
+  {
+    encoded = bump_alloc(transientStorage, REWIND_MAX_DELTA_SIZE, ALLOC_TAG_GAME);
+    if(!encoded)
+    {
+      return;
+    }
+    size = rewind_encode_delta((char*)&rewindState->keyframe, (char*)state,
+                               encoded, REWIND_MAX_DELTA_SIZE);
+    isKeyframe = !size;
+  }
+
+  if(isKeyframe)
+  {
+    keyframe = newFrame;
+    encoded = bump_alloc(transientStorage, rle_max_encoded_size(sizeof(GameState)),
+                         ALLOC_TAG_GAME);
+    if(!encoded)
+    {
+      return;
+    }
+    size = rle_encode((unsigned char*)state, sizeof(GameState), (unsigned char*)encoded);
+    rewindState->keyframe = *state;
+    rewindState->needsKeyframe = false;
+  }
+
+  int offset = rewind_reserve(size);
+  memcpy(rewindState->data + offset, encoded, size);
+  rewindState->writeOffset = offset + size;
+
+  // A Keyframe reserving its Space could have dropped everything
+  if(!rewindState->frameCount)
+  {
+    rewindState->firstFrame = newFrame;
+  }
+  *get_rewind_frame(newFrame) = {offset, size, keyframe};
+  rewindState->frameCount = newFrame - rewindState->firstFrame + 1;
+
+#ifndef SM_RELEASE
+  SM_ASSERT(rewind_check_frames(), "Rewind Frames overlap, Frame %d at %d", newFrame, offset);
+#endif
+
+  rewindState->recordMs = (get_time_us() - startUs) / 1000.0;
+}
+
+// ticksBack 0 is the newest Frame, the Ring is left untouched
+bool rewind_restore(GameState* state, int ticksBack)
+{
+  if(ticksBack < 0 || ticksBack >= rewindState->frameCount)
+  {
+    return false;
+  }
+
+  long long startUs = get_time_us();
+  int frameIdx = rewindState->firstFrame + rewindState->frameCount - 1 - ticksBack;
+  RewindFrame* frame = get_rewind_frame(frameIdx);
+  RewindFrame* keyframe = get_rewind_frame(frame->keyframe);
+
+  bool decoded = rle_decode((unsigned char*)rewindState->data + keyframe->offset,
+                            keyframe->size, (unsigned char*)state, sizeof(GameState));
+  SM_ASSERT(decoded, "Corrupt Rewind Keyframe: %d", frame->keyframe);
+  if(frame != keyframe)
+  {
+    rewind_apply_delta(rewindState->data + frame->offset, frame->size, (char*)state);
+  }
+
+  rewindState->restoreMs = (get_time_us() - startUs) / 1000.0;
+  return true;
+}
+
+// Forgets the newest Frames, recording continues from the one before
+void rewind_discard(int frameCount)
+{
+  frameCount = min(frameCount, rewindState->frameCount);
+  if(!frameCount)
+  {
+    return;
+  }
+
+  rewindState->frameCount -= frameCount;
+  if(rewindState->frameCount)
+  {
+    RewindFrame* newest = get_rewind_frame(rewindState->firstFrame +
+                                           rewindState->frameCount - 1);
+    rewindState->writeOffset = newest->offset + newest->size;
+  }
+
+  // The Keyframe Copy might be newer than what's left, start over with a fresh one
+  rewindState->needsKeyframe = true;
+}
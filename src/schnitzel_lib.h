@@ -14,12 +14,39 @@
 // Used to get memset
 #include <string.h>
 
+// Used to get a monotonic timestamp
+#include <chrono>
+
+// Used to count Cores and to let idle Job Workers yield
+#include <thread>
+
+#ifndef _WIN32
+// Used to map Files read only
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Used to lock the persistent Arena File
+#include <sys/file.h>
+#endif
+
+#ifdef __linux__
+// Used to park idle Job Workers on a Futex
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
 // #############################################################################
 //                           Constants
 // #############################################################################
 // WAV Files
 static constexpr int NUM_CHANNELS = 2;
 static constexpr int SAMPLE_RATE = 44100;
+static constexpr int WAVE_FORMAT_PCM = 1;
+static constexpr int WAVE_FORMAT_IEEE_FLOAT = 3;
+
+// Math
+static constexpr float PI = 3.14159265359f;
 
 // #############################################################################
 //                           Defines
@@ -103,8 +130,8 @@ void _log(char* prefix, char* msg, TextColor textColor, Args... args)
 }
 
 #define SM_TRACE(msg, ...) _log("TRACE:", msg, TEXT_COLOR_GREEN, ##__VA_ARGS__);
-#define SM_WARN(msg, ...) _log("WARN:", msg, TEXT_COLOR_YELLOW, "\033[0m", ##__VA_ARGS__);
-#define SM_ERROR(msg, ...) _log("ERROR:", msg, TEXT_COLOR_RED, "\033[0m", ##__VA_ARGS__);
+#define SM_WARN(msg, ...) _log("WARN:", msg, TEXT_COLOR_YELLOW, ##__VA_ARGS__);
+#define SM_ERROR(msg, ...) _log("ERROR:", msg, TEXT_COLOR_RED, ##__VA_ARGS__);
 
 #define SM_ASSERT(x, msg, ...)     \
 {                                  \
@@ -115,6 +142,13 @@ void _log(char* prefix, char* msg, TextColor textColor, Args... args)
   }                                \
 }
 
+// For hot Accessors, compiled out of Release Builds
+#ifdef SM_RELEASE
+#define SM_BOUNDS_CHECK(x, msg, ...)
+#else
+#define SM_BOUNDS_CHECK(x, msg, ...) SM_ASSERT(x, msg, ##__VA_ARGS__)
+#endif
+
 // #############################################################################
 //                           Array
 // #############################################################################
@@ -127,8 +161,8 @@ struct Array
 
   T& operator[](int idx)
   {
-    SM_ASSERT(idx >= 0, "idx negative!");
-    SM_ASSERT(idx < count, "Idx out of bounds!");
+    SM_BOUNDS_CHECK(idx >= 0, "idx negative!");
+    SM_BOUNDS_CHECK(idx < count, "Idx out of bounds!");
     return elements[idx];
   }
 
@@ -157,6 +191,270 @@ struct Array
   }
 };
 
+// #############################################################################
+//                           Pool
+// #############################################################################
+// 16 Bits Slot and 16 Bits Generation, Generation 0 is never handed
+// out, so a zeroed Handle is always invalid
+struct PoolHandle
+{
+  unsigned int id;
+};
+
+// Like Array, but Elements keep their Handle when others get removed.
+// Elements are dense, iterate 0 to count. Slots freed by remove() are
+// parked in denseToSlot behind count. Works zero initialized, so it can
+// live in the persistent Arena and survives game.so reloads
+template<typename T, int N>
+struct Pool
+{
+  static_assert(N <= 0xFFFF, "Pool Slots have to fit into 16 Bits");
+  static constexpr int maxElements = N;
+  int count = 0;
+  int slotCount = 0;
+  T elements[N];
+
+  unsigned short denseToSlot[N];
+  unsigned short slotToDense[N];
+  unsigned short generations[N];
+
+  T& operator[](int idx)
+  {
+    SM_BOUNDS_CHECK(idx >= 0, "idx negative!");
+    SM_BOUNDS_CHECK(idx < count, "Idx out of bounds!");
+    return elements[idx];
+  }
+
+  PoolHandle add(T element)
+  {
+    SM_ASSERT(count < maxElements, "Pool Full!");
+
+    int slot = count < slotCount? denseToSlot[count] : slotCount++;
+    if(!generations[slot])
+    {
+      generations[slot] = 1;
+    }
+
+    elements[count] = element;
+    denseToSlot[count] = slot;
+    slotToDense[slot] = count++;
+
+    return {(unsigned int)generations[slot] << 16 | slot};
+  }
+
+  // nullptr if the Element was removed in the meantime
+  T* get(PoolHandle handle)
+  {
+    int slot = handle.id & 0xFFFF;
+    unsigned short generation = handle.id >> 16;
+    if(!generation || slot >= slotCount || generations[slot] != generation)
+    {
+      return nullptr;
+    }
+
+    return &elements[slotToDense[slot]];
+  }
+
+  PoolHandle handle_at(int idx)
+  {
+    SM_ASSERT(idx >= 0, "idx negative!");
+    SM_ASSERT(idx < count, "Idx out of bounds!");
+    int slot = denseToSlot[idx];
+    return {(unsigned int)generations[slot] << 16 | slot};
+  }
+
+  bool remove(PoolHandle handle)
+  {
+    if(!get(handle))
+    {
+      return false;
+    }
+
+    int slot = handle.id & 0xFFFF;
+    int idx = slotToDense[slot];
+    int lastIdx = --count;
+
+    // Last Element fills the hole, the free Slot moves behind count
+    elements[idx] = elements[lastIdx];
+    denseToSlot[idx] = denseToSlot[lastIdx];
+    slotToDense[denseToSlot[idx]] = idx;
+    denseToSlot[lastIdx] = slot;
+
+    // Stale Handles stop matching, skip 0 on wrap around
+    generations[slot]++;
+    if(!generations[slot])
+    {
+      generations[slot] = 1;
+    }
+
+    return true;
+  }
+
+  void clear()
+  {
+    while(count)
+    {
+      remove(handle_at(count - 1));
+    }
+  }
+
+  bool is_full()
+  {
+    return count == N;
+  }
+
+  // Loaders add Elements 0 to count back first, then restore the saved
+  // Slot Layout, so Handles from before the Save stay valid. Every Slot
+  // has to show up once in savedDenseToSlot, false if the Layout is broken.
+  // Nothing is written before the whole Layout is checked
+  bool restore_slots(int savedSlotCount, unsigned short* savedDenseToSlot,
+                     unsigned short* savedGenerations)
+  {
+    if(savedSlotCount < count || savedSlotCount > N)
+    {
+      return false;
+    }
+
+    bool usedSlots[N] = {};
+    for(int idx = 0; idx < savedSlotCount; idx++)
+    {
+      int slot = savedDenseToSlot[idx];
+      if(slot >= savedSlotCount || usedSlots[slot] || 
+         (idx < count && !savedGenerations[slot]))
+      {
+        return false;
+      }
+      usedSlots[slot] = true;
+    }
+
+    for(int idx = 0; idx < savedSlotCount; idx++)
+    {
+      slotToDense[savedDenseToSlot[idx]] = idx;
+    }
+    slotCount = savedSlotCount;
+    memcpy(denseToSlot, savedDenseToSlot, savedSlotCount * sizeof(unsigned short));
+    memcpy(generations, savedGenerations, savedSlotCount * sizeof(unsigned short));
+    return true;
+  }
+};
+
+// Debug Builds run this on Startup. Old Handles must not reach the
+// Element that reused their Slot, Generation 0 is skipped on wrap around
+bool check_pool()
+{
+  Pool<int, 4> pool = {};
+  PoolHandle first = pool.add(1);
+  PoolHandle second = pool.add(2);
+  PoolHandle third = pool.add(3);
+
+  bool passed = pool.remove(second) && !pool.get(second) && !pool.remove(second);
+  passed &= pool.count == 2 && *pool.get(first) == 1 && *pool.get(third) == 3;
+
+  // Reuses the Slot of second with the next Generation
+  PoolHandle reused = pool.add(4);
+  passed &= (reused.id & 0xFFFF) == (second.id & 0xFFFF) && !pool.get(second);
+  passed &= *pool.get(reused) == 4 && !pool.get({0});
+
+  for(int wrapIdx = 0; wrapIdx < 0xFFFF; wrapIdx++)
+  {
+    pool.remove(reused);
+    reused = pool.add(5);
+    passed &= (reused.id >> 16) != 0;
+  }
+
+  // A saved Layout comes back with the same Handles
+  pool.remove(first);
+  Pool<int, 4> restored = {};
+  for(int idx = 0; idx < pool.count; idx++)
+  {
+    restored.add(pool[idx]);
+  }
+  passed &= restored.restore_slots(pool.slotCount, pool.denseToSlot, pool.generations);
+  passed &= *restored.get(third) == 3 && *restored.get(reused) == 5 && !restored.get(first);
+
+  unsigned short brokenLayout[4] = {0, 0, 1, 2};
+  passed &= !restored.restore_slots(3, brokenLayout, pool.generations) && 
+            *restored.get(third) == 3;
+
+  // Slots past the Slot Count would write outside slotToDense
+  unsigned short outOfRangeLayout[4] = {0, 0xFFFF, 1, 2};
+  passed &= !restored.restore_slots(3, outOfRangeLayout, pool.generations) && 
+            *restored.get(third) == 3 && *restored.get(reused) == 5;
+
+  if(!passed)
+  {
+    SM_ERROR("Pool: Stale Handles are not rejected");
+  }
+  return passed;
+}
+
+// #############################################################################
+//                           SPSC Queue
+// #############################################################################
+// Lock-free Ring Buffer, exactly one thread pushes and exactly one
+// other thread pops. Neither side ever blocks, push() fails when full.
+// Head and Tail live on seperate Cache Lines to avoid false sharing
+template<typename T, int N>
+struct SPSCQueue
+{
+  static_assert((N & (N - 1)) == 0, "SPSCQueue size has to be a power of 2");
+  static constexpr int maxElements = N;
+
+  // Written by the Consumer
+  unsigned int head;
+  char headPadding[64 - sizeof(unsigned int)];
+
+  // Written by the Producer
+  unsigned int tail;
+  char tailPadding[64 - sizeof(unsigned int)];
+
+  T elements[N];
+
+  bool push(T element)
+  {
+    unsigned int tailLocal = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+    unsigned int headLocal = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    if(tailLocal - headLocal == N)
+    {
+      return false;
+    }
+
+    elements[tailLocal & (N - 1)] = element;
+    __atomic_store_n(&tail, tailLocal + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  bool pop(T* element)
+  {
+    unsigned int headLocal = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    unsigned int tailLocal = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    if(headLocal == tailLocal)
+    {
+      return false;
+    }
+
+    *element = elements[headLocal & (N - 1)];
+    __atomic_store_n(&head, headLocal + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  int count()
+  {
+    return (int)(__atomic_load_n(&tail, __ATOMIC_ACQUIRE) - 
+                 __atomic_load_n(&head, __ATOMIC_ACQUIRE));
+  }
+};
+
+// #############################################################################
+//                           Time
+// #############################################################################
+// Monotonic, same clock in the Platform, the Game DLL and every thread
+long long get_time_us()
+{
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
 // #############################################################################
 //                           Math stuff
 // #############################################################################
@@ -817,114 +1115,1483 @@ float superku_function(float t)
 // #############################################################################
 //                           Memeory Management
 // #############################################################################
+// Address Space is reserved up front, Pages get committed in
+// BUMP_COMMIT_SIZE steps as used grows. Fresh Pages are zero, so we
+// never touch memory we don't use. Windows still mallocs everything
+static constexpr size_t BUMP_COMMIT_SIZE = KB(64);
+static constexpr size_t HUGE_PAGE_SIZE = MB(2);
+
+// Huge Pages cut TLB misses for Arenas that get hit all over every frame
+enum HugePageMode
+{
+  HUGE_PAGES_OFF,
+  HUGE_PAGES_HUGETLB, // Reserved Pages, guaranteed but needs vm.nr_hugepages
+  HUGE_PAGES_MADVISE, // Transparent Huge Pages, the Kernel may or may not give them
+};
+
+static const char* HUGE_PAGE_MODE_NAMES[] = {"off", "MAP_HUGETLB", "MADV_HUGEPAGE"};
+
+// Which Subsystem asked for the Memory, shows up in bump_report()
+enum AllocTag
+{
+  ALLOC_TAG_UNTAGGED,
+  ALLOC_TAG_PLATFORM,
+  ALLOC_TAG_RENDER,
+  ALLOC_TAG_SOUND,
+  ALLOC_TAG_GAME,
+  ALLOC_TAG_UI,
+  ALLOC_TAG_FILE,
+  ALLOC_TAG_COUNT
+};
+
+static const char* ALLOC_TAG_NAMES[ALLOC_TAG_COUNT] =
+{
+  "Untagged",
+  "Platform",
+  "Render",
+  "Sound",
+  "Game",
+  "UI",
+  "File"
+};
+
+static constexpr int MAX_ALLOC_SITES = 64;
+static constexpr int ALLOC_SITE_FILE_LENGTH = 24;
+
+// One Entry per file:line that allocated, the Name is copied because
+// game.so and its Strings go away on Hot Reload
+struct AllocSite
+{
+  char file[ALLOC_SITE_FILE_LENGTH];
+  int line;
+  AllocTag tag;
+  int count;
+  size_t frameBytes;
+  size_t peakFrameBytes;
+  size_t totalBytes;
+};
+
+struct BumpAllocatorStats
+{
+  char* name;
+  int siteCount;
+  int droppedSites;
+  AllocSite sites[MAX_ALLOC_SITES];
+};
+
 struct BumpAllocator
 {
   size_t capacity;
   size_t used;
   char* memory;
+
+  size_t committed;
+  size_t decommitAbove; // bump_reset() gives back Pages above this, 0 keeps them
+
+  // High Water marks, frameHighWater starts over in bump_reset()
+  size_t frameHighWater;
+  size_t highWater;
+
+  BumpAllocatorStats* stats; // Optional, see bump_track()
+  HugePageMode hugePages;    // What we got, see bump_huge_page_bytes()
 };
 
-BumpAllocator make_bump_allocator(size_t size)
+size_t align_to_commit_size(size_t size)
+{
+  return (size + BUMP_COMMIT_SIZE - 1) & ~(BUMP_COMMIT_SIZE - 1);
+}
+
+#ifndef _WIN32
+// Tries MAP_HUGETLB first, then a 2 MB aligned Mapping with MADV_HUGEPAGE.
+// Committed up front, the Kernel still only faults in what we touch
+bool reserve_huge_pages(BumpAllocator* allocator, size_t size)
+{
+  size_t alignedSize = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+#ifdef MAP_HUGETLB
+  void* memory = mmap(nullptr, alignedSize, PROT_READ | PROT_WRITE, 
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if(memory != MAP_FAILED)
+  {
+    allocator->memory = (char*)memory;
+    allocator->hugePages = HUGE_PAGES_HUGETLB;
+    allocator->capacity = alignedSize;
+    allocator->committed = alignedSize;
+    return true;
+  }
+#endif
+
+  // Over reserve to cut out a 2 MB aligned Range, THP needs aligned Pages
+  char* reserved = (char*)mmap(nullptr, alignedSize + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(reserved == MAP_FAILED)
+  {
+    return false;
+  }
+
+  char* aligned = (char*)(((size_t)reserved + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+  if(aligned > reserved)
+  {
+    munmap(reserved, aligned - reserved);
+  }
+  munmap(aligned + alignedSize, reserved + HUGE_PAGE_SIZE - aligned);
+
+#ifdef MADV_HUGEPAGE
+  if(madvise(aligned, alignedSize, MADV_HUGEPAGE) == 0)
+  {
+    allocator->hugePages = HUGE_PAGES_MADVISE;
+  }
+#endif
+
+  allocator->memory = aligned;
+  allocator->capacity = alignedSize;
+  allocator->committed = alignedSize;
+  return true;
+}
+#endif
+
+BumpAllocator make_bump_allocator(size_t size, size_t decommitAbove = 0, bool hugePages = false)
 {
   BumpAllocator result = {};
 
-  size_t alignedSize = (size + 7) & ~7;
+  size_t alignedSize = align_to_commit_size(size);
   result.capacity = alignedSize;
-  result.memory = (char*)malloc(alignedSize);
+  result.decommitAbove = decommitAbove;
+  SM_ASSERT(!hugePages || !decommitAbove, "Huge Page Arenas can't decommit");
 
+#ifdef _WIN32
+  // Large Pages need SeLockMemoryPrivilege, not worth it here
+  result.memory = (char*)malloc(alignedSize);
   if(result.memory)
   {
     memset(result.memory, 0, alignedSize);
+    result.committed = alignedSize;
+  }
+#else
+  if(hugePages)
+  {
+    reserve_huge_pages(&result, size);
   }
   else
   {
-    SM_ASSERT(0, "Failed to malloc memory: %d", size);
+    void* memory = mmap(nullptr, alignedSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    result.memory = memory != MAP_FAILED? (char*)memory : nullptr;
+  }
+#endif
+
+  if(!result.memory)
+  {
+    SM_ASSERT(0, "Failed to reserve memory: %d", size);
+    return {};
   }
 
   return result;
 }
 
-char* bump_alloc(BumpAllocator* allocator, size_t size)
+// Arena backed by a shared File Mapping at a fixed Address, Pointers into
+// it stay valid when the Process restarts. The Header in front of the
+// Arena refuses Files written with a different layoutHash
+static constexpr size_t ARENA_FILE_HEADER_SIZE = BUMP_COMMIT_SIZE;
+static constexpr unsigned int ARENA_FILE_MAGIC = 'S' | 'M' << 8 | 'A' << 16 | 'F' << 24;
+
+struct ArenaFileHeader
 {
-  char* result = nullptr;
+  unsigned int magic;
+  unsigned long long layoutHash;
+  size_t capacity;
+};
 
-  size_t alignedSize = (size + 7) & ~7;
-  if(allocator->used + alignedSize <= allocator->capacity)
+// resumed tells if the Arena still holds the last Session. Returns an empty
+// Allocator if the File is in use or the Address is taken
+BumpAllocator make_file_bump_allocator(const char* path, size_t size, size_t baseAddress,
+                                       unsigned long long layoutHash, bool* resumed)
+{
+  *resumed = false;
+
+#ifdef _WIN32
+  SM_WARN("File backed Arenas are not implemented on Windows: %s", path);
+  return {};
+#else
+  size_t alignedSize = align_to_commit_size(size);
+  size_t fileSize = ARENA_FILE_HEADER_SIZE + alignedSize;
+
+  int file = open(path, O_RDWR | O_CREAT, 0644);
+  if(file < 0)
   {
-    result = allocator->memory + allocator->used;
-    allocator->used += alignedSize;
+    SM_WARN("Failed opening Arena File: %s", path);
+    return {};
   }
-  else
+
+  // Two Engines writing the same Arena would corrupt each other
+  if(flock(file, LOCK_EX | LOCK_NB) != 0)
+  {
+    SM_WARN("Arena File is used by another Process: %s", path);
+    close(file);
+    return {};
+  }
+
+  ArenaFileHeader header = {};
+  bool compatible = pread(file, &header, sizeof(header), 0) == sizeof(header) &&
+                    header.magic == ARENA_FILE_MAGIC && header.layoutHash == layoutHash &&
+                    header.capacity == alignedSize;
+  if(!compatible)
+  {
+    if(header.magic)
+    {
+      SM_WARN("Arena File has a different layout, starting fresh: %s", path);
+    }
+
+    // Truncating first zeroes everything, the File stays sparse
+    if(ftruncate(file, 0) != 0 || ftruncate(file, fileSize) != 0)
+    {
+      SM_WARN("Failed resizing Arena File: %s", path);
+      close(file);
+      return {};
+    }
+  }
+
+  int flags = MAP_SHARED;
+#ifdef MAP_FIXED_NOREPLACE
+  flags |= MAP_FIXED_NOREPLACE;
+#endif
+  char* mapping = (char*)mmap((void*)baseAddress, fileSize, PROT_READ | PROT_WRITE, flags, file, 0);
+  if(mapping == MAP_FAILED || mapping != (char*)baseAddress)
+  {
+    SM_WARN("Failed mapping Arena File at %p: %s", (void*)baseAddress, path);
+    if(mapping != MAP_FAILED)
+    {
+      munmap(mapping, fileSize);
+    }
+    close(file);
+    return {};
+  }
+
+  // The File stays open for the whole Session, it holds the Lock
+  if(!compatible)
   {
-    SM_ASSERT(0, "Bump allocator is full");
+    header = {ARENA_FILE_MAGIC, layoutHash, alignedSize};
+    memcpy(mapping, &header, sizeof(header));
   }
 
+  BumpAllocator result = {};
+  result.memory = mapping + ARENA_FILE_HEADER_SIZE;
+  result.capacity = alignedSize;
+  result.committed = alignedSize;
+  *resumed = compatible;
   return result;
+#endif
 }
 
-// #############################################################################
-//                           String Stuff
-// #############################################################################
-template <typename... Args>
-char* format_text(char* format, Args... args)
+void free_bump_allocator(BumpAllocator* allocator)
 {
-  static int bufferIdx = 0;
-  static char buffers[2][1024] = {};
-  
-  char* buffer = buffers[bufferIdx];
-  memset(buffer, 0, 1024);
-  
-  sprintf(buffer, format, args...);
-  
-  return buffer;
+#ifdef _WIN32
+  free(allocator->memory);
+#else
+  munmap(allocator->memory, allocator->capacity);
+#endif
+  *allocator = {};
 }
 
-// #############################################################################
-//                           File I/O
-// #############################################################################
-long long get_timestamp(const char* file)
+// How much of the Arena the Kernel actually backs with Huge Pages,
+// read from /proc/self/smaps. Always 0 on Windows
+size_t bump_huge_page_bytes(BumpAllocator* allocator)
 {
-    struct stat file_stat = {};
-    stat(file, &file_stat);
-    return file_stat.st_mtime;
-}
+  size_t hugeBytes = 0;
 
-bool file_exists(char* filePath)
-{
-  SM_ASSERT(filePath, "No filePath supplied!");
+#ifdef __linux__
+  FILE* smaps = fopen("/proc/self/smaps", "r");
+  if(!smaps)
+  {
+    return 0;
+  }
 
-  auto file = fopen(filePath, "rb");
-  if(!file)
+  bool inArena = false;
+  char line[256];
+  while(fgets(line, sizeof(line), smaps))
   {
-    return false;
+    size_t start, end, kiloBytes;
+    if(sscanf(line, "%zx-%zx ", &start, &end) == 2)
+    {
+      inArena = start < (size_t)allocator->memory + allocator->capacity && 
+                end > (size_t)allocator->memory;
+    }
+    else if(inArena && (sscanf(line, "AnonHugePages: %zu kB", &kiloBytes) == 1 ||
+                        sscanf(line, "Private_Hugetlb: %zu kB", &kiloBytes) == 1))
+    {
+      hugeBytes += kiloBytes * 1024;
+    }
   }
-  fclose(file);
+  fclose(smaps);
+#endif
 
-  return true;
+  return hugeBytes;
 }
 
-long get_file_size(const char* filePath)
+bool bump_commit(BumpAllocator* allocator, size_t size)
 {
-  SM_ASSERT(filePath, "No filePath supplied!");
-
-  long fileSize = 0;
-  auto file = fopen(filePath, "rb");
-  if(!file)
+#ifndef _WIN32
+  if(size > allocator->committed)
   {
-    SM_ERROR("Failed opening File: %s", filePath);
-    return 0;
+    size_t committed = align_to_commit_size(size);
+    committed = committed < allocator->capacity? committed : allocator->capacity;
+    if(mprotect(allocator->memory + allocator->committed, committed - allocator->committed, 
+                PROT_READ | PROT_WRITE) != 0)
+    {
+      SM_ASSERT(0, "Failed to commit memory: %d", committed);
+      return false;
+    }
+    allocator->committed = committed;
   }
+#endif
 
-  fseek(file, 0, SEEK_END);
-  fileSize = ftell(file);
-  fseek(file, 0, SEEK_SET);
-  fclose(file);
+  return true;
+}
 
-  return fileSize;
+// Records every bump_alloc() by Call Site into stats from now on
+void bump_track(BumpAllocator* allocator, BumpAllocatorStats* stats, char* name)
+{
+  *stats = {};
+  stats->name = name;
+  allocator->stats = stats;
 }
 
-/*
-* Reads a file into a supplied buffer. We manage our own
+AllocSite* bump_find_site(BumpAllocatorStats* stats, AllocTag tag, const char* file, int line)
+{
+  // Only keep the File Name, the Path is the same for everything
+  const char* fileName = file;
+  for(const char* c = file; *c; c++)
+  {
+    if(*c == '/' || *c == '\\')
+    {
+      fileName = c + 1;
+    }
+  }
+
+  for(int siteIdx = 0; siteIdx < stats->siteCount; siteIdx++)
+  {
+    AllocSite* site = &stats->sites[siteIdx];
+    if(site->line == line && site->tag == tag &&
+       strncmp(site->file, fileName, ALLOC_SITE_FILE_LENGTH - 1) == 0)
+    {
+      return site;
+    }
+  }
+
+  if(stats->siteCount == MAX_ALLOC_SITES)
+  {
+    stats->droppedSites++;
+    return nullptr;
+  }
+
+  AllocSite* site = &stats->sites[stats->siteCount++];
+  strncpy(site->file, fileName, ALLOC_SITE_FILE_LENGTH - 1);
+  site->line = line;
+  site->tag = tag;
+  return site;
+}
+
+// Call Sites sorted by the most they used in a single Frame
+void bump_report(BumpAllocator* allocator)
+{
+  BumpAllocatorStats* stats = allocator->stats;
+  size_t highWater = allocator->highWater > allocator->frameHighWater?
+                     allocator->highWater : allocator->frameHighWater;
+  SM_TRACE("%s Arena: %.1f of %.1f KB used, high water %.1f KB (this frame %.1f KB)",
+           stats? stats->name : "Bump", allocator->used / 1024.0, allocator->capacity / 1024.0,
+           highWater / 1024.0, allocator->frameHighWater / 1024.0);
+  if(allocator->hugePages)
+  {
+    SM_TRACE("  Huge Pages (%s): %.1f KB granted", HUGE_PAGE_MODE_NAMES[allocator->hugePages],
+             bump_huge_page_bytes(allocator) / 1024.0);
+  }
+
+  if(!stats)
+  {
+    return;
+  }
+
+  int order[MAX_ALLOC_SITES];
+  size_t tagBytes[ALLOC_TAG_COUNT] = {};
+  for(int siteIdx = 0; siteIdx < stats->siteCount; siteIdx++)
+  {
+    AllocSite* site = &stats->sites[siteIdx];
+    if(site->frameBytes > site->peakFrameBytes)
+    {
+      site->peakFrameBytes = site->frameBytes;
+    }
+    tagBytes[site->tag] += site->peakFrameBytes;
+
+    // Insertion sort, there are only a few Sites
+    int insertIdx = siteIdx;
+    while(insertIdx > 0 && 
+          stats->sites[order[insertIdx - 1]].peakFrameBytes < site->peakFrameBytes)
+    {
+      order[insertIdx] = order[insertIdx - 1];
+      insertIdx--;
+    }
+    order[insertIdx] = siteIdx;
+  }
+
+  for(int tag = 0; tag < ALLOC_TAG_COUNT; tag++)
+  {
+    if(tagBytes[tag])
+    {
+      SM_TRACE("  %-8s %10.1f KB peak", ALLOC_TAG_NAMES[tag], tagBytes[tag] / 1024.0);
+    }
+  }
+
+  for(int orderIdx = 0; orderIdx < stats->siteCount; orderIdx++)
+  {
+    AllocSite* site = &stats->sites[order[orderIdx]];
+    SM_TRACE("  %10.1f KB peak %10.1f KB total %6d allocs  %-8s %s:%d",
+             site->peakFrameBytes / 1024.0, site->totalBytes / 1024.0, site->count,
+             ALLOC_TAG_NAMES[site->tag], site->file, site->line);
+  }
+
+  if(stats->droppedSites)
+  {
+    SM_TRACE("  %d allocations from untracked Sites, raise MAX_ALLOC_SITES", 
+             stats->droppedSites);
+  }
+}
+
+char* bump_alloc(BumpAllocator* allocator, size_t size, AllocTag tag = ALLOC_TAG_UNTAGGED,
+                 const char* file = __builtin_FILE(), int line = __builtin_LINE())
+{
+  char* result = nullptr;
+
+  size_t alignedSize = (size + 7) & ~7;
+  if(allocator->used + alignedSize <= allocator->capacity)
+  {
+    if(bump_commit(allocator, allocator->used + alignedSize))
+    {
+      result = allocator->memory + allocator->used;
+      allocator->used += alignedSize;
+
+      if(allocator->used > allocator->frameHighWater)
+      {
+        allocator->frameHighWater = allocator->used;
+      }
+
+      AllocSite* site = allocator->stats? bump_find_site(allocator->stats, tag, file, line) : nullptr;
+      if(site)
+      {
+        site->count++;
+        site->frameBytes += alignedSize;
+        site->totalBytes += alignedSize;
+      }
+    }
+  }
+  else
+  {
+    bump_report(allocator);
+    SM_ASSERT(0, "Bump allocator is full, %s:%d wanted %d bytes", file, line, (int)size);
+  }
+
+  return result;
+}
+
+// Build with -DSM_POISON_TEMP_MEMORY to fill memory handed back by
+// bump_reset() and TempArena with 0xCD, stale pointers show up quickly
+void bump_poison(BumpAllocator* allocator, size_t from)
+{
+#ifdef SM_POISON_TEMP_MEMORY
+  memset(allocator->memory + from, 0xCD, allocator->used - from);
+#endif
+}
+
+// Frees everything, Pages above decommitAbove go back to the OS
+// and come back zeroed when committed again
+void bump_reset(BumpAllocator* allocator)
+{
+  bump_poison(allocator, 0);
+  allocator->used = 0;
+
+  if(allocator->frameHighWater > allocator->highWater)
+  {
+    allocator->highWater = allocator->frameHighWater;
+  }
+  allocator->frameHighWater = 0;
+
+  if(allocator->stats)
+  {
+    for(int siteIdx = 0; siteIdx < allocator->stats->siteCount; siteIdx++)
+    {
+      AllocSite* site = &allocator->stats->sites[siteIdx];
+      if(site->frameBytes > site->peakFrameBytes)
+      {
+        site->peakFrameBytes = site->frameBytes;
+      }
+      site->frameBytes = 0;
+    }
+  }
+
+#ifndef _WIN32
+  size_t keep = align_to_commit_size(allocator->decommitAbove);
+  if(allocator->decommitAbove && allocator->committed > keep)
+  {
+    madvise(allocator->memory + keep, allocator->committed - keep, MADV_DONTNEED);
+    mprotect(allocator->memory + keep, allocator->committed - keep, PROT_NONE);
+    allocator->committed = keep;
+  }
+#endif
+}
+
+// Rolls the Allocator back to where it was when the Scope ends,
+// everything allocated inside the Scope is freed. Nests fine
+struct TempArena
+{
+  BumpAllocator* allocator;
+  size_t used;
+
+  TempArena(BumpAllocator* allocator) : allocator(allocator), used(allocator->used) {}
+
+  ~TempArena()
+  {
+    SM_ASSERT(allocator->used >= used, "TempArena closed out of order");
+    bump_poison(allocator, used);
+    allocator->used = used;
+  }
+};
+
+// Binary Buddy Allocator, Blocks are minBlockSize << order. Free Blocks
+// are kept in intrusive lists, a bit per Block and order marks them free
+static constexpr int BUDDY_MAX_ORDERS = 32;
+
+struct BuddyBlock
+{
+  BuddyBlock* prev;
+  BuddyBlock* next;
+};
+
+struct BuddyAllocator
+{
+  char* memory;
+  size_t capacity;
+  size_t minBlockSize;
+  int maxOrder;
+
+  BuddyBlock* freeLists[BUDDY_MAX_ORDERS];
+  unsigned int* freeBits[BUDDY_MAX_ORDERS];
+};
+
+size_t buddy_block_size(BuddyAllocator* allocator, int order)
+{
+  return allocator->minBlockSize << order;
+}
+
+int buddy_order(BuddyAllocator* allocator, size_t size)
+{
+  int order = 0;
+  while(buddy_block_size(allocator, order) < size)
+  {
+    order++;
+  }
+
+  return order;
+}
+
+bool buddy_is_free(BuddyAllocator* allocator, char* block, int order)
+{
+  size_t blockIdx = (block - allocator->memory) / buddy_block_size(allocator, order);
+  return allocator->freeBits[order][blockIdx >> 5] & (1u << (blockIdx & 31));
+}
+
+void buddy_set_free(BuddyAllocator* allocator, char* block, int order, bool isFree)
+{
+  size_t blockIdx = (block - allocator->memory) / buddy_block_size(allocator, order);
+  unsigned int mask = 1u << (blockIdx & 31);
+  unsigned int* bits = &allocator->freeBits[order][blockIdx >> 5];
+  *bits = isFree? *bits | mask : *bits & ~mask;
+}
+
+void buddy_push(BuddyAllocator* allocator, char* memory, int order)
+{
+  BuddyBlock* block = (BuddyBlock*)memory;
+  block->prev = nullptr;
+  block->next = allocator->freeLists[order];
+  if(block->next)
+  {
+    block->next->prev = block;
+  }
+  allocator->freeLists[order] = block;
+  buddy_set_free(allocator, memory, order, true);
+}
+
+void buddy_remove(BuddyAllocator* allocator, char* memory, int order)
+{
+  BuddyBlock* block = (BuddyBlock*)memory;
+  if(block->prev)
+  {
+    block->prev->next = block->next;
+  }
+  else
+  {
+    allocator->freeLists[order] = block->next;
+  }
+  if(block->next)
+  {
+    block->next->prev = block->prev;
+  }
+  buddy_set_free(allocator, memory, order, false);
+}
+
+// Bytes of free Bits for all orders, one Bit per Block
+size_t buddy_metadata_size(size_t capacity, size_t minBlockSize)
+{
+  size_t wordCount = 0;
+  for(size_t blockCount = capacity / minBlockSize; blockCount; blockCount /= 2)
+  {
+    wordCount += (blockCount + 31) / 32;
+  }
+
+  return wordCount * sizeof(unsigned int);
+}
+
+// Capacity has to be minBlockSize times a Power of 2, the free
+// Bits are allocated from metadataAllocator
+BuddyAllocator make_buddy_allocator(char* memory, size_t capacity, size_t minBlockSize,
+                                    BumpAllocator* metadataAllocator)
+{
+  SM_ASSERT(minBlockSize >= sizeof(BuddyBlock), "Buddy Blocks too small: %d", minBlockSize);
+
+  BuddyAllocator result = {};
+  result.memory = memory;
+  result.capacity = capacity;
+  result.minBlockSize = minBlockSize;
+  result.maxOrder = buddy_order(&result, capacity);
+  SM_ASSERT(buddy_block_size(&result, result.maxOrder) == capacity,
+            "Buddy capacity not a Power of 2 Blocks: %d", capacity);
+  SM_ASSERT(result.maxOrder < BUDDY_MAX_ORDERS, "Too many Buddy orders: %d", result.maxOrder);
+
+  size_t metadataSize = buddy_metadata_size(capacity, minBlockSize);
+  unsigned int* freeBits = (unsigned int*)bump_alloc(metadataAllocator, metadataSize);
+  if(!freeBits)
+  {
+    return {};
+  }
+  memset(freeBits, 0, metadataSize);
+
+  for(int order = 0; order <= result.maxOrder; order++)
+  {
+    size_t blockCount = capacity / buddy_block_size(&result, order);
+    result.freeBits[order] = freeBits;
+    freeBits += (blockCount + 31) / 32;
+  }
+
+  buddy_push(&result, memory, result.maxOrder);
+  return result;
+}
+
+char* buddy_alloc(BuddyAllocator* allocator, size_t size)
+{
+  int order = buddy_order(allocator, size);
+  int freeOrder = order;
+  while(freeOrder <= allocator->maxOrder && !allocator->freeLists[freeOrder])
+  {
+    freeOrder++;
+  }
+
+  if(freeOrder > allocator->maxOrder)
+  {
+    return nullptr;
+  }
+
+  char* block = (char*)allocator->freeLists[freeOrder];
+  buddy_remove(allocator, block, freeOrder);
+
+  // Split down, the upper halves go back on the free lists
+  while(freeOrder > order)
+  {
+    freeOrder--;
+    buddy_push(allocator, block + buddy_block_size(allocator, freeOrder), freeOrder);
+  }
+
+  return block;
+}
+
+// Size has to be the one passed to buddy_alloc()
+void buddy_free(BuddyAllocator* allocator, char* block, size_t size)
+{
+  int order = buddy_order(allocator, size);
+
+  // Merge with free Buddies as far up as we can
+  while(order < allocator->maxOrder)
+  {
+    size_t offset = block - allocator->memory;
+    char* buddy = allocator->memory + (offset ^ buddy_block_size(allocator, order));
+    if(!buddy_is_free(allocator, buddy, order))
+    {
+      break;
+    }
+
+    buddy_remove(allocator, buddy, order);
+    block = buddy < block? buddy : block;
+    order++;
+  }
+
+  buddy_push(allocator, block, order);
+}
+
+// #############################################################################
+//                           Job System
+// #############################################################################
+// A fixed Pool of Workers, Worker 0 is the Thread that created it. Every
+// Worker owns a Chase-Lev Deque, it pushes and pops at the Bottom, idle
+// Workers steal from the Top of a random other one. Waiting on a Counter
+// runs Jobs instead of blocking, so Jobs can kick and wait for Children
+static constexpr int MAX_JOB_WORKERS = 16;
+static constexpr int JOB_QUEUE_SIZE = 4096;
+
+// Every Worker gets one, reset every Frame with the transient Storage
+static constexpr int JOB_ARENA_SIZE = MB(16);
+static constexpr int JOB_ARENA_KEEP_SIZE = MB(1);
+
+// Idle Workers spin, then yield, then park until kick_job() wakes them.
+// Linux parks them on a Futex, elsewhere they nap JOB_SLEEP_US at a time
+static constexpr int JOB_SPIN_ROUNDS = 64;
+static constexpr int JOB_YIELD_ROUNDS = 1024;
+static constexpr int JOB_SLEEP_US = 100;
+
+// Lock-free Work Stealing Deque (Chase and Lev, Memory Orders from
+// Le et al. 2013). Only the Owner calls push() and pop(), any other
+// Thread may steal(). Fixed size, push() fails when full
+template<typename T, int N>
+struct ChaseLevDeque
+{
+  static_assert((N & (N - 1)) == 0, "ChaseLevDeque size has to be a power of 2");
+  static_assert(sizeof(T) % sizeof(size_t) == 0, "ChaseLevDeque copies whole Words");
+  static constexpr int maxElements = N;
+
+  // Advanced by Thieves and by the Owner taking the last Element
+  long long top;
+  char topPadding[64 - sizeof(long long)];
+
+  // Written by the Owner
+  long long bottom;
+  char bottomPadding[64 - sizeof(long long)];
+
+  T elements[N];
+
+  // Thieves read Slots the Owner might be writing, a torn Read gets
+  // thrown away when the CAS fails. Word by Word keeps that defined
+  static void copy_element(T* dst, T* src)
+  {
+    for(int wordIdx = 0; wordIdx < (int)(sizeof(T) / sizeof(size_t)); wordIdx++)
+    {
+      __atomic_store_n((size_t*)dst + wordIdx, 
+                       __atomic_load_n((size_t*)src + wordIdx, __ATOMIC_RELAXED), 
+                       __ATOMIC_RELAXED);
+    }
+  }
+
+  bool push(T element)
+  {
+    long long bottomLocal = __atomic_load_n(&bottom, __ATOMIC_RELAXED);
+    long long topLocal = __atomic_load_n(&top, __ATOMIC_ACQUIRE);
+    if(bottomLocal - topLocal >= N)
+    {
+      return false;
+    }
+
+    // Publishes the Slot to Thieves acquiring bottom
+    copy_element(&elements[bottomLocal & (N - 1)], &element);
+    __atomic_store_n(&bottom, bottomLocal + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  // Newest first, the Owner's Cache still has its Data
+  bool pop(T* element)
+  {
+    long long bottomLocal = __atomic_load_n(&bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&bottom, bottomLocal, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long long topLocal = __atomic_load_n(&top, __ATOMIC_RELAXED);
+
+    if(topLocal > bottomLocal)
+    {
+      __atomic_store_n(&bottom, bottomLocal + 1, __ATOMIC_RELEASE);
+      return false;
+    }
+
+    copy_element(element, &elements[bottomLocal & (N - 1)]);
+    if(topLocal == bottomLocal)
+    {
+      // The last Element, a Thief might be taking it right now
+      bool won = __atomic_compare_exchange_n(&top, &topLocal, topLocal + 1, false,
+                                             __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+      __atomic_store_n(&bottom, bottomLocal + 1, __ATOMIC_RELEASE);
+      return won;
+    }
+    return true;
+  }
+
+  // Oldest first, those tend to be the biggest Chunks of Work
+  bool steal(T* element)
+  {
+    long long topLocal = __atomic_load_n(&top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long long bottomLocal = __atomic_load_n(&bottom, __ATOMIC_ACQUIRE);
+    if(topLocal >= bottomLocal)
+    {
+      return false;
+    }
+
+    // The Slot can't be reused before top moves past it, push() fails first
+    T stolen;
+    copy_element(&stolen, &elements[topLocal & (N - 1)]);
+    if(!__atomic_compare_exchange_n(&top, &topLocal, topLocal + 1, false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    {
+      return false;
+    }
+
+    *element = stolen;
+    return true;
+  }
+
+  int count()
+  {
+    long long count = __atomic_load_n(&bottom, __ATOMIC_ACQUIRE) - 
+                      __atomic_load_n(&top, __ATOMIC_ACQUIRE);
+    return count > 0? (int)count : 0;
+  }
+};
+
+struct JobWorker;
+typedef void (*JobProc)(JobWorker* worker, void* data);
+
+// Jobs left plus Child Counters that aren't done yet. A Counter with a
+// Parent holds one on the Parent while it has Jobs left, kick the Children
+// from a Job counted on the Parent so it can't hit 0 in between
+struct JobCounter
+{
+  int pending;
+  JobCounter* parent;
+};
+
+struct Job
+{
+  JobProc proc;
+  void* data;
+  JobCounter* counter;
+};
+
+struct JobSystem;
+
+struct JobWorker
+{
+  ChaseLevDeque<Job, JOB_QUEUE_SIZE> jobs;
+
+  // Per Frame Memory, only this Worker allocates from it
+  BumpAllocator arena;
+
+  JobSystem* system;
+  int index;
+  unsigned int random;
+
+  // Stats
+  long long jobsRun;
+  long long jobsStolen;
+};
+
+struct JobSystem
+{
+  int workerCount;
+
+  // Workers at and above this sit idle, bench_jobs() scales with it.
+  // They wait on it, see set_active_job_workers()
+  int activeWorkerCount;
+
+  // Idle Workers wait on wakeCount, kick_job() only bumps it while
+  // parkedWorkerCount says one does. A Wake that comes in before the
+  // Worker waits changed wakeCount, so the Wait returns right away
+  int parkedWorkerCount;
+  int wakeCount;
+
+  JobWorker workers[MAX_JOB_WORKERS];
+};
+
+// Returns once *address isn't expected anymore, or whenever it likes
+void job_futex_wait(int* address, int expected)
+{
+#ifdef __linux__
+  syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+  if(__atomic_load_n(address, __ATOMIC_RELAXED) == expected)
+  {
+    std::this_thread::sleep_for(std::chrono::microseconds(JOB_SLEEP_US));
+  }
+#endif
+}
+
+void job_futex_wake(int* address, int count)
+{
+#ifdef __linux__
+  syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+#endif
+}
+
+// Cores including the calling Thread, capped at MAX_JOB_WORKERS
+int job_default_worker_count()
+{
+  int cores = (int)std::thread::hardware_concurrency();
+  return cores < 1? 1 : (cores > MAX_JOB_WORKERS? MAX_JOB_WORKERS : cores);
+}
+
+// The Threads are left to the Platform, one job_worker_proc() for every
+// Worker but Worker 0. Returns false if an Arena couldn't be reserved
+bool init_job_system(JobSystem* system, int workerCount)
+{
+  SM_ASSERT(workerCount >= 1 && workerCount <= MAX_JOB_WORKERS, 
+            "Invalid Job Worker Count: %d", workerCount);
+
+  system->workerCount = workerCount;
+  system->activeWorkerCount = workerCount;
+  system->parkedWorkerCount = 0;
+  system->wakeCount = 0;
+  for(int workerIdx = 0; workerIdx < workerCount; workerIdx++)
+  {
+    JobWorker* worker = &system->workers[workerIdx];
+    worker->jobs.top = 0;
+    worker->jobs.bottom = 0;
+    worker->system = system;
+    worker->index = workerIdx;
+    worker->random = 0x9E3779B9u * (workerIdx + 1);
+    worker->jobsRun = 0;
+    worker->jobsStolen = 0;
+    worker->arena = make_bump_allocator(JOB_ARENA_SIZE, JOB_ARENA_KEEP_SIZE);
+    if(!worker->arena.memory)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Only between Frames, no Job may be running
+void job_system_reset_arenas(JobSystem* system)
+{
+  for(int workerIdx = 0; workerIdx < system->workerCount; workerIdx++)
+  {
+    bump_reset(&system->workers[workerIdx].arena);
+  }
+}
+
+void init_job_counter(JobCounter* counter, JobCounter* parent = nullptr)
+{
+  counter->pending = 0;
+  counter->parent = parent;
+}
+
+void job_counter_add(JobCounter* counter, int count)
+{
+  JobCounter* parent = counter->parent;
+  if(__atomic_fetch_add(&counter->pending, count, __ATOMIC_RELAXED) == 0 && parent)
+  {
+    job_counter_add(parent, 1);
+  }
+}
+
+// The Waiter may return and free the Counter as soon as it hits 0
+void job_counter_finish(JobCounter* counter)
+{
+  JobCounter* parent = counter->parent;
+  if(__atomic_fetch_sub(&counter->pending, 1, __ATOMIC_ACQ_REL) == 1 && parent)
+  {
+    job_counter_finish(parent);
+  }
+}
+
+bool job_counter_done(JobCounter* counter)
+{
+  return __atomic_load_n(&counter->pending, __ATOMIC_ACQUIRE) == 0;
+}
+
+void run_job(JobWorker* worker, Job job)
+{
+  job.proc(worker, job.data);
+  worker->jobsRun++;
+  if(job.counter)
+  {
+    job_counter_finish(job.counter);
+  }
+}
+
+// Pairs with the Fence in park_job_worker(), either the parking Worker
+// sees the pushed Job or this sees the Worker parked
+void wake_job_worker(JobSystem* system)
+{
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if(!__atomic_load_n(&system->parkedWorkerCount, __ATOMIC_ACQUIRE))
+  {
+    return;
+  }
+
+  __atomic_fetch_add(&system->wakeCount, 1, __ATOMIC_RELAXED);
+  job_futex_wake(&system->wakeCount, 1);
+}
+
+// Runs the Job right away when the Deque is full
+void kick_job(JobWorker* worker, JobProc proc, void* data, JobCounter* counter = nullptr)
+{
+  if(counter)
+  {
+    job_counter_add(counter, 1);
+  }
+
+  Job job = {proc, data, counter};
+  if(!worker->jobs.push(job))
+  {
+    run_job(worker, job);
+    return;
+  }
+  wake_job_worker(worker->system);
+}
+
+// Workers that go idle park, Workers that come back run Jobs again
+void set_active_job_workers(JobSystem* system, int workerCount)
+{
+  __atomic_store_n(&system->activeWorkerCount, workerCount, __ATOMIC_RELAXED);
+  job_futex_wake(&system->activeWorkerCount, MAX_JOB_WORKERS);
+
+  // Parked Workers past the new Count go wait on activeWorkerCount
+  __atomic_fetch_add(&system->wakeCount, 1, __ATOMIC_RELAXED);
+  job_futex_wake(&system->wakeCount, MAX_JOB_WORKERS);
+}
+
+// Own Jobs first, then one Round over the other active Workers
+bool run_one_job(JobWorker* worker)
+{
+  Job job;
+  if(worker->jobs.pop(&job))
+  {
+    run_job(worker, job);
+    return true;
+  }
+
+  JobSystem* system = worker->system;
+  int workerCount = __atomic_load_n(&system->activeWorkerCount, __ATOMIC_RELAXED);
+  if(workerCount < 2)
+  {
+    return false;
+  }
+
+  worker->random ^= worker->random << 13;
+  worker->random ^= worker->random >> 17;
+  worker->random ^= worker->random << 5;
+  int victimIdx = worker->random % workerCount;
+  for(int tryIdx = 0; tryIdx < workerCount; tryIdx++)
+  {
+    JobWorker* victim = &system->workers[(victimIdx + tryIdx) % workerCount];
+    if(victim != worker && victim->jobs.steal(&job))
+    {
+      worker->jobsStolen++;
+      run_job(worker, job);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Runs Jobs until the Counter is done, the Caller never sits idle
+void wait_for_counter(JobWorker* worker, JobCounter* counter)
+{
+  while(!job_counter_done(counter))
+  {
+    if(!run_one_job(worker))
+    {
+      std::this_thread::yield();
+    }
+  }
+}
+
+bool job_worker_active(JobWorker* worker)
+{
+  return worker->index < __atomic_load_n(&worker->system->activeWorkerCount, __ATOMIC_RELAXED);
+}
+
+// Sleeps until kick_job() or set_active_job_workers() wakes it. Counts as
+// parked before looking for Jobs one last time, see wake_job_worker()
+void park_job_worker(JobWorker* worker)
+{
+  JobSystem* system = worker->system;
+  int wakeCount = __atomic_load_n(&system->wakeCount, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&system->parkedWorkerCount, 1, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  bool hasJobs = false;
+  int workerCount = __atomic_load_n(&system->activeWorkerCount, __ATOMIC_RELAXED);
+  for(int workerIdx = 0; workerIdx < workerCount && !hasJobs; workerIdx++)
+  {
+    hasJobs = system->workers[workerIdx].jobs.count() > 0;
+  }
+
+  if(!hasJobs && job_worker_active(worker))
+  {
+    job_futex_wait(&system->wakeCount, wakeCount);
+  }
+  __atomic_fetch_sub(&system->parkedWorkerCount, 1, __ATOMIC_RELAXED);
+}
+
+// PlatformThreadProc for Workers 1 and up, runs until the Process exits
+void job_worker_proc(void* data)
+{
+  JobWorker* worker = (JobWorker*)data;
+  JobSystem* system = worker->system;
+
+  int idleRounds = 0;
+  while(true)
+  {
+    int activeWorkerCount = __atomic_load_n(&system->activeWorkerCount, __ATOMIC_RELAXED);
+    if(worker->index >= activeWorkerCount)
+    {
+      job_futex_wait(&system->activeWorkerCount, activeWorkerCount);
+      idleRounds = 0;
+      continue;
+    }
+
+    if(run_one_job(worker))
+    {
+      idleRounds = 0;
+      continue;
+    }
+
+    idleRounds++;
+    if(idleRounds < JOB_SPIN_ROUNDS)
+    {
+      continue;
+    }
+    else if(idleRounds < JOB_YIELD_ROUNDS)
+    {
+      std::this_thread::yield();
+    }
+    else
+    {
+      // Parks again right away if another Worker got the Job first
+      park_job_worker(worker);
+      idleRounds = JOB_YIELD_ROUNDS;
+    }
+  }
+}
+
+template <typename Fn>
+struct ParallelForBatch
+{
+  Fn* fn;
+  int start;
+  int end;
+};
+
+template <typename Fn>
+void parallel_for_job(JobWorker* worker, void* data)
+{
+  ParallelForBatch<Fn>* batch = (ParallelForBatch<Fn>*)data;
+  (*batch->fn)(worker, batch->start, batch->end);
+}
+
+// Calls fn(worker, start, end) for Batches of [0, count) on every Worker,
+// returns once all of them ran. Batches live in the Caller's Arena
+template <typename Fn>
+void parallel_for(JobWorker* worker, int count, int batchSize, Fn fn)
+{
+  SM_ASSERT(batchSize > 0, "Batch Size has to be positive: %d", batchSize);
+
+  int batchCount = (count + batchSize - 1) / batchSize;
+  ParallelForBatch<Fn>* batches = (ParallelForBatch<Fn>*)
+    bump_alloc(&worker->arena, sizeof(ParallelForBatch<Fn>) * batchCount, ALLOC_TAG_PLATFORM);
+  if(!batches)
+  {
+    fn(worker, 0, count);
+    return;
+  }
+
+  JobCounter counter;
+  init_job_counter(&counter);
+  for(int batchIdx = 0; batchIdx < batchCount; batchIdx++)
+  {
+    int start = batchIdx * batchSize;
+    int end = start + batchSize < count? start + batchSize : count;
+    batches[batchIdx] = {&fn, start, end};
+    kick_job(worker, parallel_for_job<Fn>, &batches[batchIdx], &counter);
+  }
+  wait_for_counter(worker, &counter);
+}
+
+// Root Jobs that kick Children on their own Counter, about a Microsecond of
+// Work each. Reports Jobs per Second for 1, 2, 4... Workers up to all of them
+static constexpr int BENCH_JOB_ROOTS = 1024;
+static constexpr int BENCH_JOB_CHILDREN = 255;
+static constexpr int BENCH_JOB_WORK = 256;
+
+void bench_job_child(JobWorker* worker, void* data)
+{
+  unsigned int random = (unsigned int)(size_t)data | 1;
+  for(int workIdx = 0; workIdx < BENCH_JOB_WORK; workIdx++)
+  {
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+  }
+
+  // Keeps the Work from being optimized out
+  static unsigned int benchSink;
+  __atomic_store_n(&benchSink, random, __ATOMIC_RELAXED);
+}
+
+void bench_job_root(JobWorker* worker, void* data)
+{
+  JobCounter* children = (JobCounter*)bump_alloc(&worker->arena, sizeof(JobCounter),
+                                                  ALLOC_TAG_PLATFORM);
+  if(!children)
+  {
+    return;
+  }
+
+  init_job_counter(children, (JobCounter*)data);
+  for(int childIdx = 0; childIdx < BENCH_JOB_CHILDREN; childIdx++)
+  {
+    kick_job(worker, bench_job_child, (void*)(size_t)childIdx, children);
+  }
+}
+
+void bench_jobs(JobSystem* system)
+{
+  constexpr int JOB_COUNT = BENCH_JOB_ROOTS * (1 + BENCH_JOB_CHILDREN);
+
+  JobWorker* worker = &system->workers[0];
+  double oneWorkerMs = 0.0;
+  for(int workerCount = 1; ; workerCount *= 2)
+  {
+    workerCount = workerCount < system->workerCount? workerCount : system->workerCount;
+    set_active_job_workers(system, workerCount);
+
+    long long stolen = 0;
+    for(int workerIdx = 0; workerIdx < system->workerCount; workerIdx++)
+    {
+      stolen -= __atomic_load_n(&system->workers[workerIdx].jobsStolen, __ATOMIC_RELAXED);
+    }
+
+    JobCounter counter;
+    init_job_counter(&counter);
+    long long startUs = get_time_us();
+    for(int rootIdx = 0; rootIdx < BENCH_JOB_ROOTS; rootIdx++)
+    {
+      kick_job(worker, bench_job_root, &counter, &counter);
+    }
+    wait_for_counter(worker, &counter);
+    double benchMs = (get_time_us() - startUs) / 1000.0;
+
+    for(int workerIdx = 0; workerIdx < system->workerCount; workerIdx++)
+    {
+      stolen += __atomic_load_n(&system->workers[workerIdx].jobsStolen, __ATOMIC_RELAXED);
+    }
+
+    oneWorkerMs = workerCount == 1? benchMs : oneWorkerMs;
+    SM_TRACE("Jobs on %2d Workers: %d Jobs in %.2f ms, %.2f M Jobs/s, %lld stolen, %.2fx",
+             workerCount, JOB_COUNT, benchMs, JOB_COUNT / (benchMs * 1000.0), stolen,
+             oneWorkerMs / benchMs);
+
+    if(workerCount == system->workerCount)
+    {
+      break;
+    }
+  }
+
+  set_active_job_workers(system, system->workerCount);
+}
+
+// F12 runs this before bench_jobs(), a lost or doubled Job shows up as a
+// wrong Count. Every other Round starts with the Workers parked
+static constexpr int CHECK_JOB_ROUNDS = 50;
+static constexpr int CHECK_JOB_COUNT = 100000;
+static constexpr int CHECK_JOB_TREE_DEPTH = 5;
+static constexpr int CHECK_JOB_TREE_CHILDREN = 4;
+
+struct CheckJobNode
+{
+  JobCounter* parent;
+  int depth;
+  int* visited;
+};
+
+void check_job_count(JobWorker* worker, void* data)
+{
+  __atomic_fetch_add((int*)data, 1, __ATOMIC_RELAXED);
+}
+
+// Kicks its Children on a Counter of its own, counted on the Parent's
+void check_job_node(JobWorker* worker, void* data)
+{
+  CheckJobNode* node = (CheckJobNode*)data;
+  check_job_count(worker, node->visited);
+  if(!node->depth)
+  {
+    return;
+  }
+
+  JobCounter* children = (JobCounter*)bump_alloc(&worker->arena, sizeof(JobCounter),
+                                                  ALLOC_TAG_PLATFORM);
+  CheckJobNode* childNodes = (CheckJobNode*)
+    bump_alloc(&worker->arena, sizeof(CheckJobNode) * CHECK_JOB_TREE_CHILDREN, ALLOC_TAG_PLATFORM);
+  if(!children || !childNodes)
+  {
+    return;
+  }
+
+  init_job_counter(children, node->parent);
+  for(int childIdx = 0; childIdx < CHECK_JOB_TREE_CHILDREN; childIdx++)
+  {
+    childNodes[childIdx] = {children, node->depth - 1, node->visited};
+    kick_job(worker, check_job_node, &childNodes[childIdx], children);
+  }
+}
+
+bool check_jobs(JobSystem* system)
+{
+  JobWorker* worker = &system->workers[0];
+  int* values = (int*)bump_alloc(&worker->arena, sizeof(int) * CHECK_JOB_COUNT, 
+                                 ALLOC_TAG_PLATFORM);
+  if(!values)
+  {
+    return false;
+  }
+
+  int treeNodeCount = 0;
+  for(int depth = 0, levelCount = 1; depth <= CHECK_JOB_TREE_DEPTH; depth++)
+  {
+    treeNodeCount += levelCount;
+    levelCount *= CHECK_JOB_TREE_CHILDREN;
+  }
+
+  long long stolen = 0;
+  for(int workerIdx = 0; workerIdx < system->workerCount; workerIdx++)
+  {
+    stolen -= __atomic_load_n(&system->workers[workerIdx].jobsStolen, __ATOMIC_RELAXED);
+  }
+
+  long long startUs = get_time_us();
+  bool passed = true;
+  for(int roundIdx = 0; roundIdx < CHECK_JOB_ROUNDS && passed; roundIdx++)
+  {
+    if(roundIdx % 2)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+
+    // Batch Sizes that don't divide the Count leave a short last Batch
+    parallel_for(worker, CHECK_JOB_COUNT, 1000 + roundIdx, [=](JobWorker*, int start, int end)
+    {
+      for(int idx = start; idx < end; idx++)
+      {
+        values[idx] = idx % 1000;
+      }
+    });
+    long long sum = 0;
+    for(int idx = 0; idx < CHECK_JOB_COUNT; idx++)
+    {
+      sum += values[idx];
+    }
+    passed &= sum == 999ll * 1000 / 2 * (CHECK_JOB_COUNT / 1000);
+
+    int visited = 0;
+    JobCounter root;
+    init_job_counter(&root);
+    CheckJobNode top = {&root, CHECK_JOB_TREE_DEPTH, &visited};
+    kick_job(worker, check_job_node, &top, &root);
+    wait_for_counter(worker, &root);
+    passed &= visited == treeNodeCount;
+
+    // Jobs that don't fit the Deque run right away
+    int counted = 0;
+    JobCounter counter;
+    init_job_counter(&counter);
+    for(int jobIdx = 0; jobIdx < JOB_QUEUE_SIZE * 3; jobIdx++)
+    {
+      kick_job(worker, check_job_count, &counted, &counter);
+    }
+    wait_for_counter(worker, &counter);
+    passed &= counted == JOB_QUEUE_SIZE * 3;
+  }
+
+  for(int workerIdx = 0; workerIdx < system->workerCount; workerIdx++)
+  {
+    stolen += __atomic_load_n(&system->workers[workerIdx].jobsStolen, __ATOMIC_RELAXED);
+  }
+
+  if(!passed)
+  {
+    SM_ERROR("Jobs: lost or ran twice on %d Workers", system->workerCount);
+    return false;
+  }
+  SM_TRACE("Jobs checked on %d Workers: %d Rounds in %.2f ms, %lld stolen", 
+           system->workerCount, CHECK_JOB_ROUNDS, (get_time_us() - startUs) / 1000.0, stolen);
+  return true;
+}
+
+// #############################################################################
+//                           String Stuff
+// #############################################################################
+template <typename... Args>
+char* format_text(char* format, Args... args)
+{
+  static int bufferIdx = 0;
+  static char buffers[2][1024] = {};
+  
+  char* buffer = buffers[bufferIdx];
+  memset(buffer, 0, 1024);
+  
+  sprintf(buffer, format, args...);
+  
+  return buffer;
+}
+
+// #############################################################################
+//                           File I/O
+// #############################################################################
+long long get_timestamp(const char* file)
+{
+    struct stat file_stat = {};
+    stat(file, &file_stat);
+    return file_stat.st_mtime;
+}
+
+bool file_exists(char* filePath)
+{
+  SM_ASSERT(filePath, "No filePath supplied!");
+
+  auto file = fopen(filePath, "rb");
+  if(!file)
+  {
+    return false;
+  }
+  fclose(file);
+
+  return true;
+}
+
+long get_file_size(const char* filePath)
+{
+  SM_ASSERT(filePath, "No filePath supplied!");
+
+  long fileSize = 0;
+  auto file = fopen(filePath, "rb");
+  if(!file)
+  {
+    SM_ERROR("Failed opening File: %s", filePath);
+    return 0;
+  }
+
+  fseek(file, 0, SEEK_END);
+  fileSize = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  fclose(file);
+
+  return fileSize;
+}
+
+/*
+* Reads a file into a supplied buffer. We manage our own
 * memory and therefore want more control over where it 
 * is allocated
 */
@@ -968,14 +2635,16 @@ void write_file(char* filePath, char* buffer, int size)
   fclose(file);
 }
 
-char* read_file(const char* filePath, int* fileSize, BumpAllocator* bumpAllocator)
+char* read_file(const char* filePath, int* fileSize, BumpAllocator* bumpAllocator,
+                AllocTag tag = ALLOC_TAG_FILE, const char* callFile = __builtin_FILE(), 
+                int callLine = __builtin_LINE())
 {
   char* file = 0;
   long fileSize2 = get_file_size(filePath);
 
   if(fileSize2)
   {
-    char* buffer = bump_alloc(bumpAllocator, fileSize2 + 1);
+    char* buffer = bump_alloc(bumpAllocator, fileSize2 + 1, tag, callFile, callLine);
 
     file = read_file(filePath, fileSize, buffer);
   }
@@ -1014,7 +2683,9 @@ bool copy_file(const char* fileName, const char* outputName, BumpAllocator* bump
 
   if(fileSize2)
   {
-    char* buffer = bump_alloc(bumpAllocator, fileSize2 + 1);
+    // The buffer is only needed while copying
+    TempArena temp(bumpAllocator);
+    char* buffer = bump_alloc(bumpAllocator, fileSize2 + 1, ALLOC_TAG_FILE);
 
     return copy_file(fileName, outputName, buffer);
   }
@@ -1022,6 +2693,57 @@ bool copy_file(const char* fileName, const char* outputName, BumpAllocator* bump
   return false;
 }
 
+// Maps a File read only and prefaults it, the OS Page Cache shares the
+// Pages between Processes. Not implemented on Windows, returns nullptr
+char* map_file(const char* filePath, int* fileSize)
+{
+  SM_ASSERT(filePath, "No filePath supplied!");
+  SM_ASSERT(fileSize, "No fileSize supplied!");
+
+  *fileSize = 0;
+#ifdef _WIN32
+  return nullptr;
+#else
+  int file = open(filePath, O_RDONLY);
+  if(file < 0)
+  {
+    SM_ERROR("Failed opening File: %s", filePath);
+    return nullptr;
+  }
+
+  struct stat fileStat = {};
+  if(fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+  {
+    close(file);
+    return nullptr;
+  }
+
+  int flags = MAP_PRIVATE;
+#ifdef __linux__
+  flags |= MAP_POPULATE;
+#endif
+
+  // The Mapping keeps the File alive
+  void* memory = mmap(nullptr, fileStat.st_size, PROT_READ, flags, file, 0);
+  close(file);
+  if(memory == MAP_FAILED)
+  {
+    SM_ERROR("Failed mapping File: %s", filePath);
+    return nullptr;
+  }
+
+  *fileSize = (int)fileStat.st_size;
+  return (char*)memory;
+#endif
+}
+
+void unmap_file(char* memory, int fileSize)
+{
+#ifndef _WIN32
+  munmap(memory, fileSize);
+#endif
+}
+
 // #############################################################################
 //                           WAV File stuff
 // #############################################################################
@@ -1029,12 +2751,13 @@ bool copy_file(const char* fileName, const char* outputName, BumpAllocator* bump
 // struct chunk
 // {
 //   unsigned int id;
-//   unsigned int size; // In bytes
+//   unsigned int size; // In bytes, odd sizes are padded by one byte
 //   ...
 // }
-// we are ASSUMING!!!! That we have a "Riff Chunk"
-// followed by a "Format Chunk" followed by a
-// "Data Chunk", this CAN! be wrong ofcourse
+// after the "RIFF" Chunk header and the "WAVE" format come the Sub Chunks,
+// we walk them and only look at "fmt " and "data", anything else (LIST,
+// fact, cue, ...) is skipped. The WAVHeader is filled in canonical form,
+// it's also the layout we write WAV Files with
 struct WAVHeader
 {
   // Riff Chunk
@@ -1057,28 +2780,169 @@ struct WAVHeader
 	unsigned int dataChunkSize;
 };
 
+struct WAVChunkHeader
+{
+  char id[4];
+  unsigned int size;
+};
+
 struct WAVFile
 {
-	WAVHeader header;
-	char dataBegin;
+  WAVHeader header;
+  int dataOffset; // Of the data Chunk in the File
+  char* data;     // Points into the loaded File
 };
-WAVFile* load_wav(char* path, BumpAllocator* bumpAllocator)
+
+static constexpr int WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+// Reads a "fmt " Chunk body into the header
+bool wav_read_format_chunk(char* chunk, unsigned int chunkSize, WAVHeader* header)
+{
+  if(chunkSize < 16)
+  {
+    return false;
+  }
+
+  memcpy(&header->audioFormat, chunk, 16);
+  header->formatChunkSize = 16;
+
+  // The real Format is in the first two bytes of the SubFormat GUID
+  if(header->audioFormat == WAVE_FORMAT_EXTENSIBLE && chunkSize >= 26)
+  {
+    memcpy(&header->audioFormat, chunk + 24, sizeof(unsigned short));
+  }
+
+  return true;
+}
+
+void wav_init_header_ids(WAVHeader* header)
+{
+  memcpy(&header->riffChunkId, "RIFF", 4);
+  memcpy(&header->format, "WAVE", 4);
+  memcpy(&header->formatChunkId, "fmt ", 4);
+  memcpy(&header->dataChunkId, "data", 4);
+}
+
+// Walks the Chunks of a WAV File in memory
+bool parse_wav(char* fileData, int fileSize, WAVFile* wavFile)
+{
+  *wavFile = {};
+  if(fileSize < 12 || memcmp(fileData, "RIFF", 4) != 0 || memcmp(fileData + 8, "WAVE", 4) != 0)
+  {
+    return false;
+  }
+
+  bool foundFormat = false;
+  int offset = 12;
+  while(offset + (int)sizeof(WAVChunkHeader) <= fileSize)
+  {
+    WAVChunkHeader chunk;
+    memcpy(&chunk, fileData + offset, sizeof(WAVChunkHeader));
+    offset += sizeof(WAVChunkHeader);
+    unsigned int available = fileSize - offset;
+    unsigned int chunkSize = chunk.size < available? chunk.size : available;
+
+    if(memcmp(chunk.id, "fmt ", 4) == 0)
+    {
+      foundFormat = wav_read_format_chunk(fileData + offset, chunkSize, 
+                                          &wavFile->header);
+    }
+    else if(memcmp(chunk.id, "data", 4) == 0)
+    {
+      // Truncated Files play what is there
+      wavFile->header.dataChunkSize = chunkSize;
+      wavFile->dataOffset = offset;
+      wavFile->data = fileData + offset;
+      break;
+    }
+
+    if(chunk.size >= available)
+    {
+      break;
+    }
+    offset += chunk.size + (chunk.size & 1);
+  }
+
+  if(!foundFormat || !wavFile->data || !wavFile->header.blockAlign)
+  {
+    return false;
+  }
+
+  wav_init_header_ids(&wavFile->header);
+  wavFile->header.riffChunkSize = 36 + wavFile->header.dataChunkSize;
+  return true;
+}
+
+bool load_wav(char* path, BumpAllocator* bumpAllocator, WAVFile* wavFile)
 {
-	int fileSize = 0;
-	WAVFile* wavFile = (WAVFile*)read_file(path, &fileSize, bumpAllocator);
-	if(!wavFile) 
+  int fileSize = 0;
+  char* fileData = read_file(path, &fileSize, bumpAllocator, ALLOC_TAG_SOUND);
+  if(!fileData) 
   { 
     SM_ASSERT(0, "Failed to load Wave File: %s", path);
-    return {}; 
+    return false; 
+  }
+
+  // Other Rates, Channels and Bit Depths get converted by the Sound Code
+  if(!parse_wav(fileData, fileSize, wavFile))
+  {
+    SM_ASSERT(0, "WAV File not in propper format: %s", path);
+    return false;
+  }
+
+  return true;
+}
+
+// Only reads the Header, used by Sounds that are streamed from disk.
+// Same Chunk walk as parse_wav(), but seeks over Chunks instead
+bool read_wav_header(char* path, WAVHeader* header, int* dataOffset)
+{
+  auto file = fopen(path, "rb");
+  if(!file)
+  {
+    SM_ERROR("Failed opening File: %s", path);
+    return false;
   }
 
-	SM_ASSERT(wavFile->header.numChannels == NUM_CHANNELS, 
-            "We only support 2 channels for now!");
-	SM_ASSERT(wavFile->header.sampleRate == SAMPLE_RATE, 
-            "We only support 44100 sample rate for now!");
+  *header = {};
+  char riff[12];
+  bool foundFormat = false;
+  bool foundData = false;
+  if(fread(riff, sizeof(riff), 1, file) == 1 &&
+     memcmp(riff, "RIFF", 4) == 0 && memcmp(riff + 8, "WAVE", 4) == 0)
+  {
+    WAVChunkHeader chunk;
+    while(fread(&chunk, sizeof(chunk), 1, file) == 1)
+    {
+      if(memcmp(chunk.id, "fmt ", 4) == 0 && chunk.size <= 64)
+      {
+        char formatChunk[64];
+        foundFormat = fread(formatChunk, chunk.size, 1, file) == 1 &&
+                      wav_read_format_chunk(formatChunk, chunk.size, header);
+        fseek(file, chunk.size & 1, SEEK_CUR);
+      }
+      else if(memcmp(chunk.id, "data", 4) == 0)
+      {
+        header->dataChunkSize = chunk.size;
+        *dataOffset = (int)ftell(file);
+        foundData = true;
+        break;
+      }
+      else
+      {
+        fseek(file, chunk.size + (chunk.size & 1), SEEK_CUR);
+      }
+    }
+  }
+  fclose(file);
 
-	SM_ASSERT(memcmp(&wavFile->header.dataChunkId, "data", 4) == 0, 
-						"WAV File not in propper format");
+  if(!foundFormat || !foundData || !header->blockAlign)
+  {
+    SM_ERROR("Failed reading WAV Header: %s", path);
+    return false;
+  }
 
-	return wavFile;
+  wav_init_header_ids(header);
+  header->riffChunkSize = 36 + header->dataChunkSize;
+  return true;
 }
@@ -1,13 +1,19 @@
 #pragma once
 #include "schnitzel_lib.h"
+#include "resampler.h"
 
 // #############################################################################
 //                           Sound Constants
 // #############################################################################
+// Voices actually mixed, the Linux Mixer tracks more as virtual Voices
 static constexpr int MAX_CONCURRENT_SOUNDS = 16;
 static constexpr int MAX_ALLOCATED_SOUNDS = 64;
-static constexpr int SOUNDS_BUFFER_SIZE = MB(128);
+static constexpr int SOUNDS_BUFFER_SIZE = MB(128); // Power of 2 Blocks
+static constexpr int SOUND_BLOCK_SIZE = KB(4);
+static constexpr int SOUND_CACHE_BUDGET = MB(64);
 static constexpr int MAX_SOUND_PATH_LENGTH = 256;
+static constexpr int SOUND_HASH_SLOTS = 128; // Power of 2, > MAX_ALLOCATED_SOUNDS
+static constexpr int AUDIO_QUEUE_SIZE = 256;
 
 static constexpr float FADE_DURATION = 1.0f;
 
@@ -18,32 +24,124 @@ enum SoundOptionBits
 {
 	SOUND_OPTION_FADE_OUT = BIT(0),
 	SOUND_OPTION_FADE_IN = BIT(1),
-	SOUND_OPTION_START = BIT(2),
 };
 typedef int SoundOptions;
 
+// When there are more Voices than can be mixed, higher Priorities win,
+// then louder Voices
+enum SoundPriority
+{
+	SOUND_PRIORITY_LOW = -1,
+	SOUND_PRIORITY_NORMAL = 0,
+	SOUND_PRIORITY_HIGH = 1,
+};
+
+enum SoundLoadOptionBits
+{
+	// Read in Chunks while playing, for Music and other long Sounds
+	SOUND_LOAD_STREAMING = BIT(0),
+
+	// Play straight from a read only File Mapping, no copies and the Pages
+	// are shared with other Processes. Falls back to the Cache on Windows
+	SOUND_LOAD_MAPPED = BIT(1),
+};
+typedef int SoundLoadOptions;
+
+// Index + 1 into SoundState::allocatedSounds, 0 is no Sound.
+// Handed out once by register_sound(), stays valid for the whole session
+typedef unsigned int SoundHandle;
+
 struct Sound
 {
 	char path[MAX_SOUND_PATH_LENGTH];
-	float volume = 1.0f;
-	SoundOptions options;
+	unsigned int pathHash;
 	int size;
-	char* data;
+	char* data; // nullptr while evicted, reloaded when played
+
+	// For LRU eviction, from SoundState::playCounter
+	int lastPlayed;
+
+	// Streamed Sounds have no data, the Platform reads
+	// size bytes starting at dataOffset in chunks instead
+	bool streaming;
+	int dataOffset;
+
+	// Mapped Sounds point data into the Mapping and are never evicted
+	bool mapped;
+	char* mapping;
+	int mappingSize;
+
+	// Voices started but not reported finished by the Audio Thread yet
+	int playingVoices;
+};
+
+enum AudioCommandType
+{
+	AUDIO_COMMAND_PLAY,
+	AUDIO_COMMAND_STOP,
+	AUDIO_COMMAND_FADE_OUT,
+	AUDIO_COMMAND_SET_VOLUME,
+};
+
+// Game -> Audio, applies to every Voice playing the Sound
+struct AudioCommand
+{
+	AudioCommandType type;
+	SoundHandle sound;
+	SoundOptions options;
+	float volume;
+	int priority; // SoundPriority
+
+	long long enqueueUs; // For Latency measurements, from get_time_us()
+};
+
+enum AudioEventType
+{
+	AUDIO_EVENT_VOICE_FINISHED,
+};
+
+// Audio -> Game
+struct AudioEvent
+{
+	AudioEventType type;
+	SoundHandle sound;
 };
 
 struct SoundState
 {
-	// Buffer containing all Sounds
-	int bytesUsed;
-	char* allocatedsoundsBuffer;
+	// PCM Cache, resident Sounds are evicted least recently played
+	// first once cachedBytes would exceed cacheBudget
+	BuddyAllocator soundsAllocator;
+	int cacheBudget;
+	int cachedBytes;
+	int playCounter;
+	int cacheHits;
+	int cacheMisses;
+	int cacheEvictions;
+	int mappedBytes;
 
 	BumpAllocator* transientStorage;
 
-	// Allocted sounds
-	Array<Sound, MAX_CONCURRENT_SOUNDS> allocatedSounds;
+	// Allocted sounds, interned by path
+	Array<Sound, MAX_ALLOCATED_SOUNDS> allocatedSounds;
+
+	// Open addressing, Linear Probing, stores SoundHandles
+	SoundHandle soundSlots[SOUND_HASH_SLOTS];
 
-	// Used by the platform to determine when to start and stop sounds
-	Array<Sound, MAX_CONCURRENT_SOUNDS> playingSounds;
+	// The Game produces Commands and consumes Events, the Audio Thread
+	// does the opposite, neither side ever waits on the other
+	SPSCQueue<AudioCommand, AUDIO_QUEUE_SIZE> commands;
+	SPSCQueue<AudioEvent, AUDIO_QUEUE_SIZE> events;
+	int droppedCommands;
+	int deferredEvents;
+
+	// Finished Voices the Event Queue had no room for, per Sound. Only the
+	// Audio Thread touches these, they are sent before any newer Event
+	int unsentFinishedCount;
+	int unsentFinished[MAX_ALLOCATED_SOUNDS];
+
+	// Set while Replays seek, play_sound() ignores everything
+	bool muted;
 };
 
 // #############################################################################
@@ -54,49 +152,401 @@ static SoundState* soundState;
 // #############################################################################
 //                           Sound Functions
 // #############################################################################
-void play_sound(Sound sound)
+Sound* get_sound(SoundHandle handle)
+{
+	SM_ASSERT(handle, "Invalid Sound Handle!");
+	return &soundState->allocatedSounds[handle - 1];
+}
+
+// FNV-1a
+unsigned int hash_sound_path(char* path)
+{
+	unsigned int hash = 2166136261u;
+	while(char c = *(path++))
+	{
+		hash ^= (unsigned char)c;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+int sound_block_size(Sound* sound)
+{
+	BuddyAllocator* allocator = &soundState->soundsAllocator;
+	return buddy_block_size(allocator, buddy_order(allocator, sound->size));
+}
+
+void evict_sound(Sound* sound)
+{
+	SM_ASSERT(sound->data, "Sound not resident: %s", sound->path);
+	SM_ASSERT(!sound->playingVoices, "Evicting playing Sound: %s", sound->path);
+
+	buddy_free(&soundState->soundsAllocator, sound->data, sound->size);
+	soundState->cachedBytes -= sound_block_size(sound);
+	soundState->cacheEvictions++;
+	sound->data = nullptr;
+}
+
+// Only Sounds no Voice is playing can be evicted, the Audio
+// Thread might still read from the others
+bool evict_least_recently_played_sound()
+{
+	Sound* lruSound = nullptr;
+	for(int soundIdx = 0; soundIdx < soundState->allocatedSounds.count; soundIdx++)
+	{
+		Sound* sound = &soundState->allocatedSounds[soundIdx];
+		if(sound->data && !sound->mapped && !sound->playingVoices &&
+			 (!lruSound || sound->lastPlayed < lruSound->lastPlayed))
+		{
+			lruSound = sound;
+		}
+	}
+
+	if(!lruSound)
+	{
+		return false;
+	}
+
+	evict_sound(lruSound);
+	return true;
+}
+
+// Evicts until the Sound fits into the Budget and the Allocator
+char* alloc_sound_data(Sound* sound)
+{
+	int blockSize = sound_block_size(sound);
+	while(true)
+	{
+		if(soundState->cachedBytes + blockSize <= soundState->cacheBudget)
+		{
+			if(char* data = buddy_alloc(&soundState->soundsAllocator, sound->size))
+			{
+				soundState->cachedBytes += blockSize;
+				return data;
+			}
+		}
+
+		if(!evict_least_recently_played_sound())
+		{
+			return nullptr;
+		}
+	}
+}
+
+// Loads the WAV file into the Cache, converting it if needed
+bool load_sound_data(Sound* sound)
+{
+	SM_ASSERT(!sound->streaming, "Streamed Sounds are not cached: %s", sound->path);
+
+	// File and conversion buffers are gone once the PCM is in the Cache
+	TempArena temp(soundState->transientStorage);
+	WAVFile wavFile = {};
+	if(!load_wav(sound->path, soundState->transientStorage, &wavFile))
+	{
+		return false;
+	}
+
+	WAVHeader* header = &wavFile.header;
+	bool native = wav_is_native_format(header);
+	if(!native && !wav_can_convert(header))
+	{
+		SM_ASSERT(0, "Unsupported WAV Format: %d, %d Bits, Sound Path: %s",
+							header->audioFormat, header->bitsPerSample, sound->path);
+		return false;
+	}
+
+	// Converted Sounds are 44100 Hz Stereo int16, same as the Mixer
+	sound->size = native? header->dataChunkSize : 
+												converted_frame_count(header) * NUM_CHANNELS * sizeof(short);
+	sound->data = alloc_sound_data(sound);
+	if(!sound->data)
+	{
+		SM_ASSERT(0, "Exausted Sound Cache!\nBudget:\t%d\nBytes Cached:\t%d\nSound Path:\t%s\nSound Size:\t%d",
+								 soundState->cacheBudget, soundState->cachedBytes, sound->path, sound->size);
+		return false;
+	}
+
+	if(native)
+	{
+		memcpy(sound->data, wavFile.data, sound->size);
+	}
+	else if(!convert_wav(header, wavFile.data, (short*)sound->data, soundState->transientStorage))
+	{
+		SM_ERROR("Failed converting Sound: %s", sound->path);
+		buddy_free(&soundState->soundsAllocator, sound->data, sound->size);
+		soundState->cachedBytes -= sound_block_size(sound);
+		sound->data = nullptr;
+		return false;
+	}
+
+	return true;
+}
+
+// Only native Format Sounds can be mapped, the Mixer reads them as is
+bool map_sound_data(Sound* sound)
+{
+	int fileSize = 0;
+	char* mapping = map_file(sound->path, &fileSize);
+	if(!mapping)
+	{
+		return false;
+	}
+
+	WAVFile wavFile = {};
+	if(!parse_wav(mapping, fileSize, &wavFile) || !wav_is_native_format(&wavFile.header))
+	{
+		unmap_file(mapping, fileSize);
+		return false;
+	}
+
+	sound->mapped = true;
+	sound->mapping = mapping;
+	sound->mappingSize = fileSize;
+	sound->size = wavFile.header.dataChunkSize;
+	sound->data = wavFile.data;
+	soundState->mappedBytes += fileSize;
+	return true;
+}
+
+// The persistent Arena came back from a File, the Cache and Handles are
+// fine but Mappings, Voices and queued Messages died with the old Process
+void resume_sounds()
 {
-	// We can stop sounds using this function but if no
-	// options are supplied, at least SOUND_OPTION_START
-	// should be used.
-	sound.options = sound.options? sound.options : SOUND_OPTION_START;
+	soundState->commands = {};
+	soundState->events = {};
+	soundState->unsentFinishedCount = 0;
+	memset(soundState->unsentFinished, 0, sizeof(soundState->unsentFinished));
+	soundState->mappedBytes = 0;
 
-	// Look for existing Sound to play
 	for(int soundIdx = 0; soundIdx < soundState->allocatedSounds.count; soundIdx++)
 	{
-		Sound allocatedSound = soundState->allocatedSounds[soundIdx];
+		Sound* sound = &soundState->allocatedSounds[soundIdx];
+		sound->playingVoices = 0;
+
+		if(sound->mapped)
+		{
+			// Falls back to the Cache on the next play_sound()
+			sound->mapped = false;
+			sound->mapping = nullptr;
+			sound->data = nullptr;
+			map_sound_data(sound);
+		}
+	}
+}
+
+// Shrinking the Budget evicts right away, as far as possible
+void set_sound_cache_budget(int budget)
+{
+	soundState->cacheBudget = min(budget, SOUNDS_BUFFER_SIZE);
+	while(soundState->cachedBytes > soundState->cacheBudget &&
+				evict_least_recently_played_sound());
+}
 
-		if(strcmp(allocatedSound.path, sound.path) == 0)
+// Interns the path and loads the WAV file the first time a path is seen,
+// do this once at init and keep the Handle around. Use streaming for
+// music and other long Sounds, they are never fully loaded into memory
+SoundHandle register_sound(char* path, SoundLoadOptions options = 0)
+{
+	SM_ASSERT(path, "No Sound path supplied!");
+
+	unsigned int pathHash = hash_sound_path(path);
+	int slotIdx = pathHash & (SOUND_HASH_SLOTS - 1);
+	while(SoundHandle handle = soundState->soundSlots[slotIdx])
+	{
+		Sound* sound = get_sound(handle);
+		if(sound->pathHash == pathHash && strcmp(sound->path, path) == 0)
 		{
-			// Use allocated Sound
-			allocatedSound.options = sound.options;
-			soundState->playingSounds.add(allocatedSound);
-			return;
+			return handle;
 		}
+		slotIdx = (slotIdx + 1) & (SOUND_HASH_SLOTS - 1);
+	}
+
+	if(soundState->allocatedSounds.is_full())
+	{
+		SM_ASSERT(0, "Exausted Sounds, MAX_ALLOCATED_SOUNDS: %d", MAX_ALLOCATED_SOUNDS);
+		return 0;
 	}
 
-	// Couldn't find a Sound, Load WAV file if presend and allocate
-	WAVFile* wavFile = load_wav(sound.path, soundState->transientStorage);
-	if(wavFile)
+	Sound sound = {};
+	memcpy(sound.path, path, min((int)strlen(path), MAX_SOUND_PATH_LENGTH - 1));
+	sound.pathHash = pathHash;
+
+	bool streaming = options & SOUND_LOAD_STREAMING;
+#ifdef _WIN32
+	// XAudio2 Voices play from memory, there is no streaming on Windows yet
+	streaming = false;
+#endif
+
+	WAVHeader header = {};
+	int dataOffset = 0;
+	if(!read_wav_header(path, &header, &dataOffset))
+	{
+		return 0;
+	}
+
+	if(streaming && !wav_is_native_format(&header))
+	{
+		// The Mixer streams raw Samples, so convert once and cache it instead
+		SM_WARN("Can't stream %s, %d Hz %d Channels %d Bits, loading it instead",
+						path, header.sampleRate, header.numChannels, header.bitsPerSample);
+		streaming = false;
+	}
+
+	if(streaming)
+	{
+		sound.streaming = true;
+		sound.size = header.dataChunkSize;
+		sound.dataOffset = dataOffset;
+	}
+	else if(options & SOUND_LOAD_MAPPED && map_sound_data(&sound))
+	{
+		// Playing straight from the Mapping
+	}
+	else
 	{
-		if(wavFile->header.dataChunkSize > SOUNDS_BUFFER_SIZE - soundState->bytesUsed)
+		// Warm the Cache, play_sound() reloads it if it gets evicted
+		sound.lastPlayed = ++soundState->playCounter;
+		if(!load_sound_data(&sound))
 		{
-			SM_ASSERT(0, "Exausted Sounds Buffer!\nCapacity:\t%d\nBytes Used:\t%d\nSound Path:\t%s\nSound Size:\t%d",
-									 SOUNDS_BUFFER_SIZE, soundState->bytesUsed, sound.path, wavFile->header.dataChunkSize);
-			return;
+			return 0;
 		}
-		sound.size = wavFile->header.dataChunkSize;
-		sound.data = &soundState->allocatedsoundsBuffer[soundState->bytesUsed];
-		soundState->bytesUsed += sound.size;
-		memcpy(sound.data, &wavFile->dataBegin, sound.size);
+	}
+
+	SoundHandle handle = soundState->allocatedSounds.add(sound) + 1;
+	soundState->soundSlots[slotIdx] = handle;
+	return handle;
+}
 
-		soundState->allocatedSounds.add(sound);
-		soundState->playingSounds.add(sound);
+void push_audio_command(AudioCommand command)
+{
+	command.enqueueUs = get_time_us();
+	if(!soundState->commands.push(command))
+	{
+		soundState->droppedCommands++;
+		SM_WARN("Audio Command Queue full, dropping Command: %d", command.type);
+		return;
+	}
+
+	if(command.type == AUDIO_COMMAND_PLAY)
+	{
+		get_sound(command.sound)->playingVoices++;
 	}
 }
 
-void stop_sound(Sound sound)
+// Only SOUND_OPTION_FADE_IN changes how a Sound starts
+void play_sound(SoundHandle handle, SoundOptions options = 0, float volume = 1.0f,
+								int priority = SOUND_PRIORITY_NORMAL)
 {
-	sound.options = SOUND_OPTION_FADE_OUT;
-	play_sound(sound);
-}
\ No newline at end of file
+	if(!handle || soundState->muted)
+	{
+		return;
+	}
+
+	Sound* sound = get_sound(handle);
+	sound->lastPlayed = ++soundState->playCounter;
+	if(!sound->streaming)
+	{
+		if(sound->data)
+		{
+			soundState->cacheHits++;
+		}
+		else
+		{
+			soundState->cacheMisses++;
+			if(!load_sound_data(sound))
+			{
+				return;
+			}
+		}
+	}
+
+	AudioCommand command = {};
+	command.type = AUDIO_COMMAND_PLAY;
+	command.sound = handle;
+	command.options = options;
+	command.volume = volume;
+	command.priority = priority;
+	push_audio_command(command);
+}
+
+void stop_sound(SoundHandle handle, bool fadeOut = true)
+{
+	if(!handle)
+	{
+		return;
+	}
+
+	AudioCommand command = {};
+	command.type = fadeOut? AUDIO_COMMAND_FADE_OUT : AUDIO_COMMAND_STOP;
+	command.sound = handle;
+	push_audio_command(command);
+}
+
+void set_sound_volume(SoundHandle handle, float volume)
+{
+	if(!handle)
+	{
+		return;
+	}
+
+	AudioCommand command = {};
+	command.type = AUDIO_COMMAND_SET_VOLUME;
+	command.sound = handle;
+	command.volume = volume;
+	push_audio_command(command);
+}
+
+bool is_sound_playing(SoundHandle handle)
+{
+	return handle && get_sound(handle)->playingVoices > 0;
+}
+
+// Called by the Game once per Frame to consume Events from the Audio Thread
+void update_sounds()
+{
+	AudioEvent event;
+	while(soundState->events.pop(&event))
+	{
+		switch(event.type)
+		{
+			case AUDIO_EVENT_VOICE_FINISHED:
+			{
+				Sound* sound = get_sound(event.sound);
+				sound->playingVoices = max(sound->playingVoices - 1, 0);
+				break;
+			}
+		}
+	}
+}
+
+// Called by the Audio Thread once per Period and before every Event
+void flush_audio_events()
+{
+	for(int soundIdx = 0; soundState->unsentFinishedCount && soundIdx < MAX_ALLOCATED_SOUNDS;
+	    soundIdx++)
+	{
+		while(soundState->unsentFinished[soundIdx])
+		{
+			if(!soundState->events.push({AUDIO_EVENT_VOICE_FINISHED, (SoundHandle)soundIdx + 1}))
+			{
+				return;
+			}
+			soundState->unsentFinished[soundIdx]--;
+			soundState->unsentFinishedCount--;
+		}
+	}
+}
+
+// Called by the Audio Thread, never blocks. Dropping a finished Voice would
+// keep its Sound playing forever, so it waits for room in the Queue instead
+void push_audio_event(AudioEvent event)
+{
+	flush_audio_events();
+	if(soundState->unsentFinishedCount || !soundState->events.push(event))
+	{
+		soundState->unsentFinished[event.sound - 1]++;
+		soundState->unsentFinishedCount++;
+		soundState->deferredEvents++;
+	}
+}
@@ -8,6 +8,7 @@
 //                           UI Constants
 // #############################################################################
 constexpr int MAX_UI_ELEMENTS = 100;
+constexpr int MAX_UI_TEXTS = 100;
 constexpr int MAX_TEXT_CHARS = 256;
 
 // #############################################################################
@@ -19,26 +20,43 @@ struct UIID
   int layer;
 };
 
+// Widgets are retained across ticks and looked up by their ID, the
+// hit rect and Transform are only rebuilt when sprite or pos change
 struct UIElement
 {
+  int ID;
+  int lastTick;
   SpriteID spriteID;
   Vec2 pos;
+
+  // Cached Layout
+  IRect rect;
+  Transform transform;
 };
 
 struct UIText
 {
+  int ID;
+  int lastTick;
   int charCount;
   char text[MAX_TEXT_CHARS];
   Vec2 pos;
+
+  // Cached Layout, one Transform per Glyph
+  Array<Transform, MAX_TEXT_CHARS> transforms;
 };
 
 struct UIState
 {
+  // Incremented every update_ui(), widgets not submitted
+  // during the last tick get removed
+  int tick;
+
   UIID hotLastFrame;
   UIID hotThisFrame;
   UIID active;
 
-  Array<UIText, 100> texts;
+  Array<UIText, MAX_UI_TEXTS> texts;
   Array<UIElement, MAX_UI_ELEMENTS> uiElements;
 };
 
@@ -58,7 +76,25 @@ void update_ui()
     uiState->active = {};
   }
 
-  uiState->uiElements.clear();
+  uiState->tick++;
+
+  // Remove retained Widgets that weren't submitted last tick
+  for(int eleIdx = uiState->uiElements.count - 1; eleIdx >= 0; eleIdx--)
+  {
+    if(uiState->uiElements[eleIdx].lastTick < uiState->tick - 1)
+    {
+      uiState->uiElements.remove_idx_and_swap(eleIdx);
+    }
+  }
+
+  for(int textIdx = uiState->texts.count - 1; textIdx >= 0; textIdx--)
+  {
+    if(uiState->texts[textIdx].lastTick < uiState->tick - 1)
+    {
+      uiState->texts.remove_idx_and_swap(textIdx);
+    }
+  }
+
   uiState->hotLastFrame = uiState->hotThisFrame;
   uiState->hotThisFrame = {};
 }
@@ -91,23 +127,61 @@ bool ui_is_hot()
   return uiState->hotLastFrame.ID || uiState->hotLastFrame.ID;
 }
 
+UIElement* get_ui_element(int ID)
+{
+  for(int eleIdx = 0; eleIdx < uiState->uiElements.count; eleIdx++)
+  {
+    if(uiState->uiElements[eleIdx].ID == ID)
+    {
+      return &uiState->uiElements[eleIdx];
+    }
+  }
+
+  // Register a new Element, SPRITE_COUNT forces a layout on first use
+  UIElement uiElement = {};
+  uiElement.ID = ID;
+  uiElement.spriteID = SPRITE_COUNT;
+  int eleIdx = uiState->uiElements.add(uiElement);
+  return &uiState->uiElements[eleIdx];
+}
+
+UIText* get_ui_text(int ID)
+{
+  for(int textIdx = 0; textIdx < uiState->texts.count; textIdx++)
+  {
+    if(uiState->texts[textIdx].ID == ID)
+    {
+      return &uiState->texts[textIdx];
+    }
+  }
+
+  // Register a new Text, charCount of -1 forces a layout on first use
+  UIText uiText = {};
+  uiText.ID = ID;
+  uiText.charCount = -1;
+  int textIdx = uiState->texts.add(uiText);
+  return &uiState->texts[textIdx];
+}
+
 bool do_button(SpriteID spriteID, IVec2 pos, int ID)
 {
-  Sprite sprite = get_sprite(spriteID);
   IVec2 mousePosWold = screen_to_ui(input->mousePos);
-  // Draw UI Element (Adds to an array of elements to draw during render())
+
+  // Keep the UI Element alive (Drawn during draw() using the cached Transform)
+  UIElement* uiElement = get_ui_element(ID);
+  uiElement->lastTick = uiState->tick;
+  if(uiElement->spriteID != spriteID || uiElement->pos != vec_2(pos))
   {
-    UIElement uiElement = 
-    {
-      .spriteID = spriteID,
-      .pos = vec_2(pos),
-    };
-    uiState->uiElements.add(uiElement);
+    Sprite sprite = get_sprite(spriteID);
+    uiElement->spriteID = spriteID;
+    uiElement->pos = vec_2(pos);
+    uiElement->rect = {pos.x - sprite.size.x / 2, 
+                       pos.y - sprite.size.y / 2,
+                       sprite.size};
+    uiElement->transform = get_transform(spriteID, uiElement->pos);
   }
 
-  IRect rect = {pos.x - sprite.size.x / 2, 
-                pos.y - sprite.size.y / 2,
-                sprite.size};
+  IRect rect = uiElement->rect;
   if(is_active(ID))
   {
     if(key_released_this_frame(KEY_MOUSE_LEFT) &&
@@ -134,20 +208,40 @@ bool do_button(SpriteID spriteID, IVec2 pos, int ID)
   return false;
 }
 
-void do_ui_text(char* text, Vec2 pos)
+void do_ui_text(const char* text, Vec2 pos, int ID)
 {
-  UIText uiText = {};
-  memcpy(uiText.text, text, strlen(text));
-  uiText.charCount = strlen(text);
-  uiText.pos = pos;
+  SM_ASSERT(text, "No Text Supplied!");
+
+  UIText* uiText = get_ui_text(ID);
+  uiText->lastTick = uiState->tick;
+
+  int charCount = min((int)strlen(text), MAX_TEXT_CHARS - 1);
+  if(uiText->charCount == charCount && 
+     uiText->pos == pos &&
+     memcmp(uiText->text, text, charCount) == 0)
+  {
+    return;
+  }
+
+  // Content or Position changed, layout the Glyphs again
+  memcpy(uiText->text, text, charCount);
+  uiText->text[charCount] = 0;
+  uiText->charCount = charCount;
+  uiText->pos = pos;
 
-  uiState->texts.add(uiText);
+  uiText->transforms.clear();
+  for(int charIdx = 0; charIdx < charCount; charIdx++)
+  {
+    Glyph glyph = renderData->glyphs[uiText->text[charIdx]];
+    uiText->transforms.add(get_transform(pos, glyph));
+    pos.x += glyph.advance.x;
+  }
 }
 
 template <typename... Args>
-void do_format_ui_text(char* format, Vec2 pos, Args... args)
+void do_format_ui_text(char* format, Vec2 pos, int ID, Args... args)
 {
   char* text = format_text(format, args...);
-  do_ui_text(text, pos);
+  do_ui_text(text, pos, ID);
 }
 
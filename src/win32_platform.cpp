@@ -14,7 +14,9 @@ struct xAudioVoice : IXAudio2VoiceCallback
 	IXAudio2SourceVoice* voice;
   SoundOptions options;
   float fadeTimer;
-  char* soundPath;
+  float volume;
+  SoundHandle sound;
+  int priority;
 
   int playing;
 
@@ -519,6 +521,71 @@ bool platform_free_dynamic_library(void* dll)
   return (bool)freeResult;
 }
 
+// Copies inside the OS, no Buffer on our side
+bool platform_copy_file(const char* fileName, const char* outputName)
+{
+  return CopyFileA(fileName, outputName, FALSE);
+}
+
+// Writes fileName.tmp, flushes it and moves it over fileName,
+// Readers see the old or the new File, never half of one
+bool platform_write_file_atomic(const char* fileName, char* buffer, int size)
+{
+  char tmpName[256];
+  snprintf(tmpName, sizeof(tmpName), "%s.tmp", fileName);
+
+  HANDLE file = CreateFileA(tmpName, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, 
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if(file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+
+  DWORD written = 0;
+  bool flushed = WriteFile(file, buffer, size, &written, nullptr) && 
+                 written == (DWORD)size && FlushFileBuffers(file);
+  CloseHandle(file);
+  if(!flushed || 
+     !MoveFileExA(tmpName, fileName, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+  {
+    DeleteFileA(tmpName);
+    return false;
+  }
+
+  return true;
+}
+
+struct Win32ThreadStart
+{
+  PlatformThreadProc threadProc;
+  void* data;
+};
+
+DWORD WINAPI win32_thread_start(LPVOID arg)
+{
+  Win32ThreadStart start = *(Win32ThreadStart*)arg;
+  free(arg);
+  start.threadProc(start.data);
+  return 0;
+}
+
+// Detached, runs until the Process exits
+bool platform_create_thread(PlatformThreadProc threadProc, void* data)
+{
+  Win32ThreadStart* start = (Win32ThreadStart*)malloc(sizeof(Win32ThreadStart));
+  *start = {threadProc, data};
+
+  HANDLE thread = CreateThread(nullptr, 0, win32_thread_start, start, 0, nullptr);
+  if(!thread)
+  {
+    free(start);
+    return false;
+  }
+  CloseHandle(thread);
+
+  return true;
+}
+
 void glDebugMessageCallback (GLDEBUGPROC callback, const void *userParam)
 {
   glDebugMessageCallback_ptr(callback, userParam);
@@ -561,32 +628,61 @@ bool thread_safe_set_bool_to_true(volatile int* var)
 	return InterlockedCompareExchange((LONG*)var, true, false) == false;
 }
 
+void win32_stop_voice(xAudioVoice* voice)
+{
+  voice->voice->Stop();
+  voice->voice->FlushSourceBuffers(); // Remove the buffer from the voice
+  voice->options = 0;
+  voice->fadeTimer = 0.0f;
+  InterlockedExchange((LONG*)&voice->playing, false);
+}
+
 void platform_update_audio(float dt)
 {
-  for(int soundIdx = 0; soundIdx < soundState->playingSounds.count; soundIdx++)
+  flush_audio_events();
+  AudioCommand command;
+  while(soundState->commands.pop(&command))
   {
-    Sound* sound = &soundState->playingSounds[soundIdx];
-
     // Playing Sounds
-    if(sound->options & SOUND_OPTION_START ||
-       sound->options & SOUND_OPTION_FADE_IN)
+    if(command.type == AUDIO_COMMAND_PLAY)
     {
+      Sound* sound = get_sound(command.sound);
       SM_ASSERT(sound->size > 0, "Sound has no Samples Size: %d", 
                                     sound->size);
       SM_ASSERT(sound->data, "Sound has no Data!");
-      sound->options = 0;
 
       xAudioVoice* voice = nullptr;
       for(int voiceIdx = 0; voiceIdx < MAX_CONCURRENT_SOUNDS; voiceIdx++)
       {
         xAudioVoice* possibleVoice = &voiceArr[voiceIdx];
-        if(!possibleVoice->playing)
+        if(!possibleVoice->playing && !possibleVoice->sound)
         {
           voice = possibleVoice;
           break;
         }
       }
 
+      // XAudio2 has no virtual Voices, steal the lowest Priority one instead
+      if(!voice)
+      {
+        for(int voiceIdx = 0; voiceIdx < MAX_CONCURRENT_SOUNDS; voiceIdx++)
+        {
+          xAudioVoice* possibleVoice = &voiceArr[voiceIdx];
+          if(possibleVoice->sound && possibleVoice->priority < command.priority &&
+             (!voice || possibleVoice->priority < voice->priority))
+          {
+            voice = possibleVoice;
+          }
+        }
+
+        if(voice)
+        {
+          win32_stop_voice(voice);
+          push_audio_event({AUDIO_EVENT_VOICE_FINISHED, voice->sound});
+          voice->sound = 0;
+        }
+      }
+
       if(voice != nullptr) 
       { 
         XAUDIO2_BUFFER buffer = {};
@@ -597,28 +693,52 @@ void platform_update_audio(float dt)
         HRESULT hr = voice->voice->SubmitSourceBuffer(&buffer);
         if(!FAILED(hr)) 
         {
+          voice->sound = command.sound;
+          voice->volume = command.volume;
+          voice->priority = command.priority;
+          voice->options = command.options & SOUND_OPTION_FADE_IN;
+          voice->fadeTimer = 0.0f;
+          voice->voice->SetVolume(voice->options? 0.0f : voice->volume * musicVolume);
           voice->voice->Start();
-          voice->soundPath = sound->path;
 		      InterlockedExchange((LONG*)&voice->playing, true);
+          continue;
         }
       }
+
+      // The Game still counts this Voice as playing
+      push_audio_event({AUDIO_EVENT_VOICE_FINISHED, command.sound});
+      continue;
     }
 
-    // Stopping Sounds
-    if(sound->options & SOUND_OPTION_FADE_OUT)
+    for(int voiceIdx = 0; voiceIdx < MAX_CONCURRENT_SOUNDS; voiceIdx++)
     {
-      xAudioVoice* voice = nullptr;
-      for(int voiceIdx = 0; voiceIdx < MAX_CONCURRENT_SOUNDS; voiceIdx++)
+      xAudioVoice* voice = &voiceArr[voiceIdx];
+      if(!voice->playing || voice->sound != command.sound)
       {
-        xAudioVoice* possibleVoice = &voiceArr[voiceIdx];
-        if(!possibleVoice->playing)
+        continue;
+      }
+
+      switch(command.type)
+      {
+        case AUDIO_COMMAND_STOP:
         {
-          continue;
+          win32_stop_voice(voice);
+          break;
+        }
+
+        // Stopping Sounds
+        case AUDIO_COMMAND_FADE_OUT:
+        {
+          voice->options = SOUND_OPTION_FADE_OUT;
+          voice->fadeTimer = 0.0f;
+          break;
         }
 
-        if(strcmp(possibleVoice->soundPath, sound->path) == 0)
+        case AUDIO_COMMAND_SET_VOLUME:
         {
-          possibleVoice->options = SOUND_OPTION_FADE_OUT;
+          voice->volume = command.volume;
+          voice->voice->SetVolume(voice->volume * musicVolume);
+          break;
         }
       }
     }
@@ -629,11 +749,21 @@ void platform_update_audio(float dt)
   {
     xAudioVoice* voice = &voiceArr[voiceIdx];
 
+    // OnStreamEnd() runs on the XAudio2 Thread, we report
+    // finished Voices from here to keep a single Producer
+    if(voice->sound && !voice->playing)
+    {
+      push_audio_event({AUDIO_EVENT_VOICE_FINISHED, voice->sound});
+      voice->sound = 0;
+      voice->options = 0;
+      continue;
+    }
+
     if(voice->options & SOUND_OPTION_FADE_IN)
     {
       voice->fadeTimer = min(voice->fadeTimer + dt, FADE_DURATION);
       float t = voice->fadeTimer / FADE_DURATION;
-      voice->voice->SetVolume(t * musicVolume);
+      voice->voice->SetVolume(t * voice->volume * musicVolume);
 
       if(voice->fadeTimer == FADE_DURATION)
       {
@@ -650,20 +780,14 @@ void platform_update_audio(float dt)
     {
       voice->fadeTimer = min(voice->fadeTimer + dt, FADE_DURATION);
       float t = 1.0f - voice->fadeTimer / FADE_DURATION;
-      voice->voice->SetVolume(t * musicVolume);
+      voice->voice->SetVolume(t * voice->volume * musicVolume);
 
       if(voice->fadeTimer == FADE_DURATION)
       {
-        voice->options ^= SOUND_OPTION_FADE_OUT;
-        voice->voice->Stop();
-        voice->voice->FlushSourceBuffers(); // Remove the buffer from the voice
-        voice->voice->SetVolume(1.0f); // Reset Volume
-        voice->fadeTimer = 0.0f;
+        win32_stop_voice(voice);
       }
     }
   }
-
-  soundState->playingSounds.count = 0;
 }
 
 void platform_sleep(unsigned int ms)